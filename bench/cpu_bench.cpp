@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fmt/core.h>
+#include <emu/core/apu.hpp>
+#include <emu/core/bus.hpp>
+#include <emu/core/controller.hpp>
+#include <emu/core/cpu.hpp>
+#include <emu/debugger/debugger.hpp>
+#include <emu/util/io.hpp>
+#include <emu/util/string.hpp>
+
+/*
+ * Measures how long the CPU takes to run each official opcode, one
+ * instruction at a time, the same way CPUTest runs them: the instruction
+ * is placed in a flat 64 KiB memory, the registers are reset and the
+ * instruction is run, over and over. Indexed modes that may cross a page
+ * (abs,x abs,y (ind),y) are run both crossing and not crossing one, and
+ * branches taken, not taken and taken to another page.
+ * The cost of resetting the registers is measured on its own and taken
+ * out. Results are printed slowest first and written to a tab-separated
+ * file (instructions have commas in them), so that two runs (e.g. before
+ * and after a change to dispatch) can be compared opcode by opcode.
+ * Build with: make build=release cpu_bench
+ * Usage: cpu_bench [OUTPUT.tsv] [ITERATIONS]
+ */
+
+using namespace core;
+using Clock = std::chrono::steady_clock;
+
+static constexpr u16 CODE       = 0x0400;
+static constexpr u16 CODE_CROSS = 0x04F0;   // for branches to the next page
+static constexpr u8 INDEX       = 0x10;     // X and Y
+static constexpr int RUNS       = 5;        // the fastest run is kept
+
+struct Case {
+    u8 id = 0;
+    u8 low = 0, high = 0;
+    u16 pc = CODE;
+    u8 flags = 0;
+    std::string text = {};
+    std::string_view mode = {};
+    std::string_view variant = {};
+    unsigned cycles = 0;
+    double ns = 0;
+};
+
+// tells the addressing mode from the disassembly
+static std::string_view mode_of(std::string_view text)
+{
+    auto op = text.size() > 4 ? text.substr(4) : std::string_view{};
+    if (op.empty())                         return "impld";
+    if (op == "A")                          return "accum";
+    if (op[0] == '#')                       return "imm";
+    if (op[0] != '$' && op[0] != '(')       return "branch";
+    if (op.ends_with("),y"))                return "indy";
+    if (op.ends_with(",x)"))                return "indx";
+    if (op[0] == '(')                       return "ind";
+    bool zero = op.size() == 3 || op[3] == ',';
+    if (op.ends_with(",x"))                 return zero ? "zerox" : "absx";
+    if (op.ends_with(",y"))                 return zero ? "zeroy" : "absy";
+    return zero ? "zero" : "abs";
+}
+
+class CPUBench {
+    Bus<CPUBUS_SIZE> bus;
+    ControllerPort port1, port2;
+    CPU cpu{&bus, &port1, &port2, &apu};
+    APU apu{&bus, &cpu};
+    std::array<u8, CPUBUS_SIZE> mem = {};
+
+    void reset(const Case &c)
+    {
+        cpu.r.pc.v = c.pc;
+        cpu.r.acc  = 0x40;
+        cpu.r.x    = INDEX;
+        cpu.r.y    = INDEX;
+        cpu.r.sp   = 0xFF;
+        cpu.r.flags.full = c.flags;
+    }
+
+public:
+    CPUBench()
+    {
+        bus.map(0, 0xffff, [&](u16 addr) { return mem[addr]; }, [&](u16 addr, u8 data) { mem[addr] = data; });
+        // pointers for (ind),y: $34 doesn't cross a page once Y is added,
+        // $36 does. other instructions use $80, so they never write to
+        // them. $90 is where (ind,x) ends up.
+        mem[0x34] = 0x20; mem[0x35] = 0x12;
+        mem[0x36] = 0xF8; mem[0x37] = 0x12;
+        mem[0x90] = 0x20; mem[0x91] = 0x12;
+    }
+
+    unsigned cycles(Case &c)
+    {
+        mem[c.pc] = c.id; mem[c.pc+1] = c.low; mem[c.pc+2] = c.high;
+        reset(c);
+        auto start = cpu.cycles();
+        cpu.run();
+        return cpu.cycles() - start;
+    }
+
+    double time(const Case &c, unsigned iterations)
+    {
+        mem[c.pc] = c.id; mem[c.pc+1] = c.low; mem[c.pc+2] = c.high;
+        double best = 1e9;
+        for (int run = 0; run < RUNS; run++) {
+            auto start = Clock::now();
+            for (unsigned i = 0; i < iterations; i++) {
+                reset(c);
+                cpu.run();
+            }
+            best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+        }
+        return best * 1e9 / iterations;
+    }
+
+    double overhead(unsigned iterations)
+    {
+        Case c{ .id = 0xEA, .low = 0, .high = 0 };
+        double best = 1e9;
+        for (int run = 0; run < RUNS; run++) {
+            auto start = Clock::now();
+            for (unsigned i = 0; i < iterations; i++) {
+                reset(c);
+                asm volatile("" : : "r"(&cpu) : "memory");
+            }
+            best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+        }
+        return best * 1e9 / iterations;
+    }
+
+    std::vector<Case> cases();
+};
+
+std::vector<Case> CPUBench::cases()
+{
+    std::vector<Case> list;
+    const auto add = [&](Case c, std::string_view variant) {
+        c.text = debugger::disassemble(c.id, c.low, c.high).first;
+        c.mode = mode_of(c.text);
+        c.variant = variant;
+        c.cycles = cycles(c);
+        list.push_back(c);
+    };
+    for (unsigned id = 0; id < 0x100; id++) {
+        Case c{ .id = u8(id), .low = 0x80, .high = 0x12 };
+        auto text = debugger::disassemble(c.id, c.low, c.high).first;
+        if (text == "[Unknown]")
+            continue;
+        auto mode = mode_of(text);
+        if (mode == "absx" || mode == "absy") {
+            add({ .id = c.id, .low = 0x20, .high = 0x12 }, "no page cross");
+            add({ .id = c.id, .low = 0xF8, .high = 0x12 }, "page cross");
+        } else if (mode == "indy") {
+            add({ .id = c.id, .low = 0x34, .high = 0 }, "no page cross");
+            add({ .id = c.id, .low = 0x36, .high = 0 }, "page cross");
+        } else if (mode == "branch") {
+            // one of these two takes the branch: N, V, Z and C all clear or all set
+            for (u8 flags : { 0x00, 0xC3 }) {
+                Case b{ .id = c.id, .low = 0x20, .high = 0, .flags = flags };
+                bool taken = cycles(b) > 2;
+                add(b, taken ? "taken" : "not taken");
+                if (taken) {
+                    b.pc = CODE_CROSS;
+                    add(b, "taken to next page");
+                }
+            }
+        } else
+            add(c, "");
+    }
+    return list;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string_view output = argc > 1 ? argv[1] : "cpu_bench.tsv";
+    std::optional<int> iterations = argc > 2 ? str::to_num(std::string_view(argv[2])) : 200'000;
+    if (!iterations || iterations.value() <= 0) {
+        fmt::print(stderr, "usage: {} [OUTPUT.tsv] [ITERATIONS]\n", argv[0]);
+        return 1;
+    }
+
+    CPUBench bench;
+    auto list = bench.cases();
+    double overhead = bench.overhead(iterations.value());
+    for (auto &c : list)
+        c.ns = std::max(bench.time(c, iterations.value()) - overhead, 0.0);
+    std::sort(list.begin(), list.end(), [](const auto &a, const auto &b) { return a.ns > b.ns; });
+
+    fmt::print("{} cases, {} iterations each, {:.2f} ns of overhead taken out\n",
+               list.size(), iterations.value(), overhead);
+    fmt::print("op  instruction     mode    variant             cycles      ns  ns/cycle\n");
+    double total_ns = 0, total_cycles = 0;
+    for (const auto &c : list) {
+        fmt::print("{:02X}  {:<15} {:<7} {:<19} {:>6} {:>7.2f} {:>9.2f}\n",
+                   c.id, c.text, c.mode, c.variant, c.cycles, c.ns, c.ns / c.cycles);
+        total_ns += c.ns;
+        total_cycles += c.cycles;
+    }
+    fmt::print("average: {:.2f} ns per instruction, {:.2f} ns per cycle\n",
+               total_ns / list.size(), total_ns / total_cycles);
+
+    auto file = io::File::open(output, io::Access::Write);
+    if (!file) {
+        fmt::print(stderr, "couldn't open {}\n", output);
+        return 1;
+    }
+    fmt::print(file.value().data(), "opcode\tinstruction\tmode\tvariant\tcycles\tns\n");
+    for (const auto &c : list)
+        fmt::print(file.value().data(), "{:02X}\t{}\t{}\t{}\t{}\t{:.3f}\n", c.id, c.text, c.mode, c.variant, c.cycles, c.ns);
+    return 0;
+}
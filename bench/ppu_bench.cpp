@@ -0,0 +1,179 @@
+#include <array>
+#include <chrono>
+#include <string_view>
+#include <vector>
+#include <fmt/core.h>
+#include <emu/core/bus.hpp>
+#include <emu/core/const.hpp>
+#include <emu/core/mapper.hpp>
+#include <emu/core/ppu.hpp>
+#include <emu/core/screen.hpp>
+#include <emu/util/bits.hpp>
+#include <emu/util/string.hpp>
+
+/*
+ * Measures how fast the PPU runs whole frames under synthetic scenes,
+ * without a ROM: the PPU is set up on its own, with CHR, nametables and
+ * palette filled with made-up data behind NROM and a stub bus, and is
+ * driven one line at a time through its registers, as a game would. For
+ * each scene, it reports ns per dot and frames per second.
+ * Build with: make build=release ppu_bench
+ * Usage: ppu_bench [FRAMES]
+ */
+
+using namespace core;
+using namespace bits::literals;
+using Clock = std::chrono::steady_clock;
+
+static constexpr unsigned VBLANK_LINE = 241;
+
+enum class Sprites { None, Spread, PerLine };
+
+struct Scene {
+    std::string_view name;
+    u8 ctrl;                        // PPUCTRL
+    u8 mask;                        // PPUMASK
+    Sprites sprites = Sprites::None;
+    bool splits     = false;        // scroll changed every 16 lines
+    bool ppudata    = false;        // 14 PPUDATA writes per line
+};
+
+static const Scene scenes[] = {
+    { "rendering off",           0x00, 0x00 },
+    { "background only",         0x10, 0x0A },
+    { "64 sprites spread out",   0x10, 0x1E, Sprites::Spread },
+    { "8 sprites per line",      0x10, 0x1E, Sprites::PerLine },
+    { "8x16 sprites",            0x30, 0x1E, Sprites::Spread },
+    { "mid-frame scroll splits", 0x10, 0x1E, Sprites::Spread, true },
+    { "PPUDATA writes",          0x00, 0x00, Sprites::None, false, true },
+};
+
+class PPUBench {
+    core::Bus<PPUBUS_SIZE> bus;
+    Screen screen;
+    PPU ppu{&bus, &screen};
+    std::vector<u8> prg = std::vector<u8>(32_KiB);
+    std::vector<u8> chr = std::vector<u8>(8_KiB);
+    NROM mapper{nullptr, prg, chr};
+    std::array<u8, VRAM_SIZE> vram;
+    std::array<u8, PAL_SIZE> pal;
+    const Scene *scene = nullptr;
+    unsigned long dots = 0;
+
+    void write(u16 reg, u8 data) { ppu.writereg(reg, data); }
+
+    // runs until the next line starts, then does what the scene does
+    // between lines
+    void run_line()
+    {
+        unsigned line = ppu.lines;
+        do {
+            ppu.run();
+            dots++;
+        } while (ppu.lines == line);
+        line = ppu.lines;
+
+        if (line == VBLANK_LINE) {
+            ppu.readreg(0x2002);
+            write(0x2000, scene->ctrl);
+            write(0x2005, 0);
+            write(0x2005, 0);
+            if (scene->ppudata) {
+                write(0x2006, 0x20);
+                write(0x2006, 0x00);
+            }
+        }
+        // the usual $2006/$2005/$2005/$2006 sequence, which changes both
+        // scrolls in the middle of a frame
+        if (scene->splits && line < 240 && line % 16 == 8) {
+            u8 x = line * 3, y = line / 2;
+            write(0x2006, 0);
+            write(0x2005, y);
+            write(0x2005, x);
+            write(0x2006, (y & 0xF8) << 2 | x >> 3);
+        }
+        if (scene->ppudata)
+            for (int i = 0; i < 14; i++)
+                write(0x2007, line + i);
+    }
+
+    void run_frame()
+    {
+        do
+            run_line();
+        while (ppu.lines != VBLANK_LINE);
+    }
+
+    void load_sprites(Sprites layout)
+    {
+        write(0x2003, 0);
+        for (unsigned i = 0; i < 64; i++) {
+            unsigned col = i % 8, row = i / 8;
+            u8 y = layout == Sprites::Spread  ? 8 + row * 28
+                 : layout == Sprites::PerLine ? 8 + row * 29
+                 : 0xFF;
+            u8 x = layout == Sprites::Spread ? 8 + col * 30 : col * 32;
+            // palettes, priority and flips all vary
+            write(0x2004, y);
+            write(0x2004, i * 2);
+            write(0x2004, (i & 3) | (i & 0x1C) << 3);
+            write(0x2004, x);
+        }
+    }
+
+public:
+    PPUBench()
+    {
+        // made-up, but not uniform, so that nothing is skipped
+        u32 seed = 0x12345678;
+        const auto next = [&] { seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5; return u8(seed); };
+        for (auto &b : chr) b = next();
+        for (auto &b : vram) b = next();
+        for (auto &b : pal) b = next() & 0x3F;
+        ppu.map_nametables(vram.data(), vram.data() + 0x400, vram.data(), vram.data() + 0x400);
+        ppu.set_mapper(&mapper);
+        ppu.on_nmi([](bool) { });
+        bus.map(PT_START, NT_START,  [this](u16 addr) { return mapper.read_chr(addr); }, [this](u16 addr, u8 data) { mapper.write_chr(addr, data); });
+        bus.map(PAL_START, 0x4000,   [this](u16 addr) { return pal[addr & 0x1F]; },     [this](u16 addr, u8 data) { pal[addr & 0x1F] = data; });
+        bus.map(NT_START, PAL_START, [this](u16 addr) { return ppu.nametable(addr); },  [this](u16 addr, u8 data) { ppu.nametable(addr) = data; });
+    }
+
+    // returns the time taken, in seconds
+    double run(const Scene &s, unsigned frames)
+    {
+        scene = &s;
+        ppu.power(false);
+        while (ppu.lines != VBLANK_LINE)
+            ppu.run();
+        load_sprites(s.sprites);
+        write(0x2001, s.mask);
+        // one frame to settle
+        run_frame();
+        dots = 0;
+        auto start = Clock::now();
+        for (unsigned i = 0; i < frames; i++)
+            run_frame();
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    unsigned long dots_run() const { return dots; }
+};
+
+int main(int argc, char *argv[])
+{
+    std::optional<int> frames = argc > 1 ? str::to_num(std::string_view(argv[1])) : 300;
+    if (!frames || frames.value() <= 0) {
+        fmt::print(stderr, "usage: {} [FRAMES]\n", argv[0]);
+        return 1;
+    }
+
+    PPUBench bench;
+    fmt::print("{} frames per scene\n", frames.value());
+    fmt::print("{:<24} {:>10} {:>8} {:>9}\n", "scene", "dots", "ns/dot", "fps");
+    for (const auto &scene : scenes) {
+        double seconds = bench.run(scene, frames.value());
+        fmt::print("{:<24} {:>10} {:>8.2f} {:>9.1f}\n", scene.name, bench.dots_run(),
+                   seconds * 1e9 / bench.dots_run(), frames.value() / seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cmath>
+#include <numbers>
+#include <vector>
+#include <fmt/core.h>
+#include <emu/core/const.hpp>
+#include <emu/util/resampler.hpp>
+
+/*
+ * Measures how many samples per second the resampler goes through, for
+ * each instruction set, on the two cases that matter to us: the APU's rate
+ * to the device's and the CPU clock to 48 kHz.
+ * Build with: make build=release benchmarks
+ */
+
+using util::Resampler;
+
+static const char *simd_name(Resampler::Simd simd)
+{
+    switch (simd) {
+    case Resampler::Simd::None: return "scalar";
+    case Resampler::Simd::SSE2: return "sse2";
+    case Resampler::Simd::AVX2: return "avx2";
+    default:                    return "auto";
+    }
+}
+
+static void bench(const char *name, Resampler::Options opts, double seconds)
+{
+    // one frame at a time, like the emulator would
+    const std::size_t chunk = opts.input_rate / 60;
+    std::vector<float> in(chunk);
+    for (std::size_t i = 0; i < chunk; i++)
+        in[i] = std::sin(2 * std::numbers::pi * 440 * i / opts.input_rate);
+    for (auto simd : { Resampler::Simd::None, Resampler::Simd::SSE2, Resampler::Simd::AVX2 }) {
+        opts.simd = simd;
+        Resampler rs{opts};
+        if (rs.simd() != simd)
+            continue;
+        std::vector<float> out;
+        out.reserve(chunk);
+        std::size_t total_in = 0, total_out = 0;
+        auto start = std::chrono::steady_clock::now();
+        double elapsed = 0;
+        while (elapsed < seconds) {
+            for (int i = 0; i < 60; i++) {
+                out.clear();
+                rs.process(in, out);
+                total_in  += in.size();
+                total_out += out.size();
+            }
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        fmt::print("{:<24} {:<7} {} taps: {:8.2f} M input samples/s, {:7.3f} M output samples/s ({:.0f}x real time)\n",
+                   name, simd_name(simd), rs.taps(), total_in / elapsed / 1e6, total_out / elapsed / 1e6,
+                   total_in / opts.input_rate / elapsed);
+    }
+}
+
+int main()
+{
+    bench("48000 -> 44100",       { .input_rate = 48000,                .output_rate = 44100, .taps = 32  }, 1.0);
+    bench("cpu clock -> 48000",   { .input_rate = core::CPU_CLOCK_RATE, .output_rate = 48000, .taps = 384 }, 1.0);
+    bench("cpu clock -> 44100",   { .input_rate = core::CPU_CLOCK_RATE, .output_rate = 44100, .taps = 384 }, 1.0);
+}
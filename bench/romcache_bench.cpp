@@ -0,0 +1,88 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include <unistd.h>
+#include <fmt/core.h>
+#include <emu/core/cartridge.hpp>
+#include <emu/core/emulator.hpp>
+#include <emu/core/romcache.hpp>
+#include <emu/util/io.hpp>
+#include <emu/util/string.hpp>
+
+/*
+ * Starts many emulator instances on the same ROM, first mapping the file
+ * once per instance, then going through the ROM cache, and reports the
+ * time it took to get each instance ready (and how much of it went into
+ * opening the ROM) and how much resident memory the ROMs added.
+ * Build with: make build=release benchmarks
+ * Usage: romcache_bench ROM [INSTANCES]
+ */
+
+static std::size_t resident_kib()
+{
+    // /proc files have no size, so io::read_file can't be used
+    FILE *f = std::fopen("/proc/self/statm", "r");
+    if (!f)
+        return 0;
+    unsigned long pages = 0;
+    if (std::fscanf(f, "%*u %lu", &pages) != 1)
+        pages = 0;
+    std::fclose(f);
+    return pages * ::sysconf(_SC_PAGESIZE) / 1024;
+}
+
+template <typename Handle>
+static void bench(const char *name, std::vector<std::unique_ptr<core::Emulator>> &instances, auto &&open, bool print = true)
+{
+    std::vector<Handle> handles;
+    handles.reserve(instances.size());
+    std::size_t rss_before = resident_kib();
+    double open_time = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto &emu : instances) {
+        auto t = std::chrono::steady_clock::now();
+        auto rom = open();
+        open_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+        if (!rom) {
+            fmt::print(stderr, "couldn't open the ROM\n");
+            std::exit(1);
+        }
+        auto cart = core::parse_cartridge(*rom);
+        if (!cart || !emu->insert_rom(cart.value())) {
+            fmt::print(stderr, "ROM not supported\n");
+            std::exit(1);
+        }
+        handles.push_back(std::move(rom));
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (print)
+        fmt::print("{:<8} {} instances: {:.1f} us per instance ({:.1f} us opening the ROM), resident memory +{} KiB\n",
+                   name, instances.size(), elapsed * 1e6 / instances.size(), open_time * 1e6 / instances.size(),
+                   resident_kib() - rss_before);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fmt::print(stderr, "usage: {} ROM [INSTANCES]\n", argv[0]);
+        return 1;
+    }
+    std::string_view path = argv[1];
+    std::optional<int> n = argc > 2 ? str::to_num(std::string_view(argv[2])) : 100;
+    if (!n || n.value() <= 0) {
+        fmt::print(stderr, "invalid number of instances\n");
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<core::Emulator>> instances;
+    for (int i = 0; i < n.value(); i++) {
+        instances.push_back(std::make_unique<core::Emulator>());
+        instances.back()->set_headless(true);
+    }
+
+    // the first ROM inserted allocates the state buffers of each instance
+    bench<std::optional<io::MappedFile>>("warmup", instances, [&] { return io::MappedFile::open(path); }, false);
+    bench<std::optional<io::MappedFile>>("mapped", instances, [&] { return io::MappedFile::open(path); });
+    bench<core::RomCache::Handle>("cached", instances, [&] { return core::RomCache::open(path); });
+}
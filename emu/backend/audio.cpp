@@ -0,0 +1,92 @@
+#include "audio.hpp"
+
+#include <algorithm>
+#include <SDL2/SDL.h>
+#include <emu/util/debug.hpp>
+
+namespace backend {
+
+bool Audio::open(AudioOpts opts)
+{
+    close();
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        warning("couldn't initialize audio: {}\n", SDL_GetError());
+        return false;
+    }
+    if (!opts.driver.empty()) {
+        SDL_AudioQuit();
+        if (SDL_AudioInit(opts.driver.data()) < 0) {
+            warning("couldn't initialize audio driver {}: {}\n", opts.driver, SDL_GetError());
+            return false;
+        }
+    }
+    SDL_AudioSpec want = {}, have;
+    want.freq     = opts.output_rate;
+    want.format   = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples  = 512;
+    want.userdata = this;
+    want.callback = [](void *userdata, Uint8 *stream, int len) {
+        static_cast<Audio *>(userdata)->fill(std::span((i16 *) stream, len / sizeof(i16)));
+    };
+    device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (device == 0) {
+        warning("couldn't open audio device: {}\n", SDL_GetError());
+        return false;
+    }
+    setup(opts.input_rate, have.freq, opts.latency);
+    SDL_PauseAudioDevice(device, 0);
+    return true;
+}
+
+void Audio::close()
+{
+    if (device == 0)
+        return;
+    SDL_CloseAudioDevice(device);
+    device = 0;
+}
+
+void Audio::setup(unsigned in_rate, unsigned out_rate, double latency)
+{
+    output_rate = out_rate;
+    target = std::max<std::size_t>(out_rate * latency, 1);
+    ring.resize(target * 2);
+    resampler.emplace(util::Resampler::Options{ .input_rate = double(in_rate), .output_rate = double(out_rate) });
+    adjust = 1.0;
+    started = false;
+}
+
+void Audio::push(std::span<const i16> samples)
+{
+    // 0 when the buffer is at the target, -1 when empty, +1 when twice as full
+    double error = std::min((double(ring.size()) - target) / target, 1.0);
+    adjust = 1.0 - MAX_RATE_DELTA * error;
+    resampler->set_output_rate(output_rate * adjust);
+    resampled.clear();
+    resampler->process(samples, resampled);
+    if (ring.push(resampled) < resampled.size())
+        overrun_count.fetch_add(1, std::memory_order_relaxed);
+    if (!started.load(std::memory_order_relaxed) && ring.size() >= target)
+        started.store(true, std::memory_order_release);
+}
+
+// called by the device. until the buffer has filled up to the target, the
+// device gets silence; after an underrun it fills up again.
+void Audio::fill(std::span<i16> out)
+{
+    if (!started.load(std::memory_order_acquire)) {
+        std::fill(out.begin(), out.end(), last);
+        return;
+    }
+    std::size_t n = ring.pop(out);
+    if (n > 0)
+        last = out[n-1];
+    if (n < out.size()) {
+        std::fill(out.begin() + n, out.end(), last);
+        underrun_count.fetch_add(1, std::memory_order_relaxed);
+        started.store(false, std::memory_order_relaxed);
+    }
+}
+
+} // namespace backend
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <emu/util/common.hpp>
+#include <emu/util/ringbuffer.hpp>
+#include <emu/util/resampler.hpp>
+
+/*
+ * Sends sound from the emulator thread to an audio device. The emulator
+ * thread push()es the samples of each frame into a lock-free ring buffer;
+ * the device's callback pops them from its own thread. Neither side ever
+ * waits for the other.
+ * The emulator is paced by video, so it produces samples a bit faster or a
+ * bit slower than the device consumes them. To make up for it, samples are
+ * resampled with a ratio that is nudged (by at most MAX_RATE_DELTA) to keep
+ * the buffer filled up to the requested latency: a fuller buffer means fewer
+ * samples are produced.
+ */
+
+namespace backend {
+
+struct AudioOpts {
+    unsigned input_rate;            // the rate the emulator produces samples at
+    unsigned output_rate = 48000;   // the rate we ask the device for
+    double latency = 0.05;          // in seconds
+    std::string_view driver = "";   // empty for SDL's default. "dummy" works without a sound card
+};
+
+class Audio {
+    util::RingBuffer<i16> ring;
+    u32 device = 0;
+    double output_rate = 0;
+    std::size_t target = 0;         // how many samples we'd like to have buffered
+
+    // producer side
+    std::optional<util::Resampler> resampler;
+    std::vector<i16> resampled;
+    double adjust = 1.0;
+
+    // consumer side
+    i16 last = 0;
+
+    std::atomic<bool> started = false;
+    std::atomic<u64> underrun_count = 0;
+    std::atomic<u64> overrun_count = 0;
+
+public:
+    static constexpr double MAX_RATE_DELTA = 0.005;
+
+    Audio() = default;
+    Audio(const Audio &) = delete;
+    Audio & operator=(const Audio &) = delete;
+    ~Audio() { close(); }
+
+    bool open(AudioOpts opts);
+    void close();
+
+    // both can be used without a device (i.e. for testing).
+    void setup(unsigned in_rate, unsigned out_rate, double latency);
+    void push(std::span<const i16> samples);
+    void fill(std::span<i16> out);
+
+    // the device ran out of samples
+    u64 underruns() const      { return underrun_count.load(std::memory_order_relaxed); }
+    // samples were dropped because the buffer was full
+    u64 overruns() const       { return overrun_count.load(std::memory_order_relaxed); }
+    double fill_level() const  { return double(ring.size()) / ring.capacity(); }
+    double rate_adjust() const { return adjust; }
+    unsigned sample_rate() const { return output_rate; }
+};
+
+} // namespace backend
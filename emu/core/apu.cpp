@@ -0,0 +1,621 @@
+#include "apu.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <emu/core/cpu.hpp>
+
+namespace core {
+
+namespace {
+
+constexpr u8 length_table[] = {
+    10, 254, 20,  2, 40,  4, 80,  6, 160,  8, 60, 10, 14, 12, 26, 14,
+    12,  16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+};
+
+constexpr u8 duty_table[4][8] = {
+    { 0, 1, 0, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 1, 1, 0, 0, 0 },
+    { 1, 0, 0, 1, 1, 1, 1, 1 },
+};
+
+// periods are in CPU cycles
+constexpr u16 noise_table[] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068,
+};
+
+constexpr u16 dmc_table[] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54,
+};
+
+// frame sequencer steps, in CPU cycles from the start of the sequence
+constexpr unsigned long frame_steps[2][5] = {
+    { 7457, 14913, 22371, 29829, 0     },
+    { 7457, 14913, 22371, 29829, 37281 },
+};
+constexpr unsigned long frame_length[2] = { 29830, 37282 };
+
+constexpr unsigned long NEVER = std::numeric_limits<unsigned long>::max();
+
+// the APU mixes its channels in a non-linear way. these are the usual
+// approximations from the nesdev wiki.
+struct MixTables {
+    float pulse[31];
+    float tnd[203];
+
+    MixTables()
+    {
+        pulse[0] = tnd[0] = 0;
+        for (int i = 1; i < 31; i++)
+            pulse[i] = 95.52 / (8128.0 / i + 100.0);
+        for (int i = 1; i < 203; i++)
+            tnd[i] = 163.67 / (24329.0 / i + 100.0);
+    }
+} const mix_tables;
+
+// band-limited steps: for each phase, the taps of a windowed sinc impulse
+// (a Blackman window, cutoff a bit below Nyquist), normalized to sum to 1.
+struct StepKernel {
+    float taps[Synth::PHASES][Synth::WIDTH];
+
+    StepKernel()
+    {
+        const double cutoff = 0.9;
+        const double half   = Synth::WIDTH / 2.0;
+        for (int p = 0; p < Synth::PHASES; p++) {
+            double sum = 0;
+            for (int k = 0; k < Synth::WIDTH; k++) {
+                double x = k - half + 1 - double(p) / Synth::PHASES;
+                double sinc = x == 0 ? 1.0 : std::sin(std::numbers::pi * cutoff * x) / (std::numbers::pi * cutoff * x);
+                double w = 0.42 + 0.5 * std::cos(std::numbers::pi * x / half) + 0.08 * std::cos(2 * std::numbers::pi * x / half);
+                taps[p][k] = sinc * w;
+                sum += taps[p][k];
+            }
+            for (int k = 0; k < Synth::WIDTH; k++)
+                taps[p][k] /= sum;
+        }
+    }
+} const step_kernel;
+
+} // namespace
+
+
+
+void Synth::set_rate(double clock_rate, unsigned sample_rate)
+{
+    factor = sample_rate / clock_rate;
+    // room for a few frames, in case one runs longer than usual
+    std::size_t frame_samples = std::ceil(frame_length[0] * factor);
+    buf.assign(frame_samples * 4 + WIDTH, 0);
+    out.reserve(frame_samples * 4);
+    clear();
+}
+
+void Synth::clear()
+{
+    std::fill(buf.begin(), buf.end(), 0);
+    out.clear();
+    offset = 0;
+    level = integrator = 0;
+    hp_prev_in = hp_prev_out = 0;
+}
+
+void Synth::update(unsigned long time, float new_level)
+{
+    float delta = new_level - level;
+    if (delta == 0)
+        return;
+    double pos = time * factor + offset;
+    std::size_t i = pos;
+    if (i + WIDTH > buf.size())
+        return;
+    level = new_level;
+    const float *taps = step_kernel.taps[int((pos - i) * PHASES)];
+    for (int k = 0; k < WIDTH; k++)
+        buf[i + k] += delta * taps[k];
+}
+
+void Synth::end_frame(unsigned long duration)
+{
+    double end = duration * factor + offset;
+    std::size_t n = std::min<std::size_t>(end, buf.size() - WIDTH);
+    // a simple high-pass filter removes the DC offset
+    const float r = 0.999f;
+    out.clear();
+    for (std::size_t i = 0; i < n; i++) {
+        integrator += buf[i];
+        float hp = integrator - hp_prev_in + r * hp_prev_out;
+        hp_prev_in  = integrator;
+        hp_prev_out = hp;
+        out.push_back(std::clamp(hp * 32767.0f, -32768.0f, 32767.0f));
+    }
+    std::copy(buf.begin() + n, buf.begin() + n + WIDTH, buf.begin());
+    std::fill(buf.begin() + WIDTH, buf.begin() + n + WIDTH, 0);
+    offset = end - n;
+}
+
+
+
+void APU::Envelope::clock()
+{
+    if (start) {
+        start   = false;
+        decay   = 15;
+        divider = period;
+    } else if (divider == 0) {
+        divider = period;
+        if (decay > 0)
+            decay--;
+        else if (loop)
+            decay = 15;
+    } else
+        divider--;
+}
+
+u16 APU::Pulse::sweep_target() const
+{
+    int change = timer >> sweep_shift;
+    if (!sweep_negate)
+        return timer + change;
+    return std::max(0, timer - change - ones_complement);
+}
+
+void APU::Pulse::clock_sweep()
+{
+    if (sweep_divider == 0 && sweep_enabled && sweep_shift != 0 && !muted())
+        timer = sweep_target();
+    if (sweep_divider == 0 || sweep_reload) {
+        sweep_divider = sweep_period;
+        sweep_reload  = false;
+    } else
+        sweep_divider--;
+}
+
+u8 APU::Pulse::output() const
+{
+    return length == 0 || muted() || !duty_table[duty][step] ? 0 : env.volume();
+}
+
+u8 APU::Triangle::output() const
+{
+    return step < 16 ? 15 - step : step - 16;
+}
+
+void APU::power(bool reset)
+{
+    pulse    = {};
+    pulse[0].ones_complement = true;
+    triangle = {};
+    noise    = {};
+    dmc      = {};
+    frame    = {};
+    frame_irq = dmc_irq = false;
+    time = frame_start = cpu->cycles();
+    pulse[0].next_clock = pulse[1].next_clock = time;
+    triangle.next_clock = noise.next_clock = dmc.next_clock = time;
+    frame.start     = time;
+    frame.next_step = time + frame_steps[0][0];
+    update_irq();
+    synth.clear();
+    schedule();
+}
+
+void APU::set_sample_rate(unsigned sample_rate)
+{
+    rate = sample_rate;
+    synth.set_rate(CPU_CLOCK_RATE, rate);
+}
+
+void APU::serialize(util::Serializer &s)
+{
+    // field by field: the channel structs have padding, which would
+    // otherwise end up in the state
+    const auto envelope = [&](Envelope &e) {
+        s(e.start,    "apu.env.start");
+        s(e.loop,     "apu.env.loop");
+        s(e.constant, "apu.env.constant");
+        s(e.period,   "apu.env.period");
+        s(e.divider,  "apu.env.divider");
+        s(e.decay,    "apu.env.decay");
+    };
+    for (auto &p : pulse) {
+        envelope(p.env);
+        s(p.enabled,         "apu.pulse.enabled");
+        s(p.duty,            "apu.pulse.duty");
+        s(p.step,            "apu.pulse.step");
+        s(p.length,          "apu.pulse.length");
+        s(p.timer,           "apu.pulse.timer");
+        s(p.next_clock,      "apu.pulse.next_clock");
+        s(p.sweep_enabled,   "apu.pulse.sweep_enabled");
+        s(p.sweep_negate,    "apu.pulse.sweep_negate");
+        s(p.sweep_reload,    "apu.pulse.sweep_reload");
+        s(p.sweep_period,    "apu.pulse.sweep_period");
+        s(p.sweep_shift,     "apu.pulse.sweep_shift");
+        s(p.sweep_divider,   "apu.pulse.sweep_divider");
+        s(p.ones_complement, "apu.pulse.ones_complement");
+    }
+    s(triangle.enabled,            "apu.triangle.enabled");
+    s(triangle.control,            "apu.triangle.control");
+    s(triangle.linear_reload,      "apu.triangle.linear_reload");
+    s(triangle.linear,             "apu.triangle.linear");
+    s(triangle.linear_reload_flag, "apu.triangle.linear_reload_flag");
+    s(triangle.step,               "apu.triangle.step");
+    s(triangle.length,             "apu.triangle.length");
+    s(triangle.timer,              "apu.triangle.timer");
+    s(triangle.next_clock,         "apu.triangle.next_clock");
+    envelope(noise.env);
+    s(noise.enabled,     "apu.noise.enabled");
+    s(noise.mode,        "apu.noise.mode");
+    s(noise.period,      "apu.noise.period");
+    s(noise.shift,       "apu.noise.shift");
+    s(noise.length,      "apu.noise.length");
+    s(noise.next_clock,  "apu.noise.next_clock");
+    s(dmc.irq_enabled,   "apu.dmc.irq_enabled");
+    s(dmc.loop,          "apu.dmc.loop");
+    s(dmc.period,        "apu.dmc.period");
+    s(dmc.level,         "apu.dmc.level");
+    s(dmc.sample_addr,   "apu.dmc.sample_addr");
+    s(dmc.sample_length, "apu.dmc.sample_length");
+    s(dmc.addr,          "apu.dmc.addr");
+    s(dmc.bytes_left,    "apu.dmc.bytes_left");
+    s(dmc.buffer,        "apu.dmc.buffer");
+    s(dmc.buffer_full,   "apu.dmc.buffer_full");
+    s(dmc.shift,         "apu.dmc.shift");
+    s(dmc.bits_left,     "apu.dmc.bits_left");
+    s(dmc.silence,       "apu.dmc.silence");
+    s(dmc.next_clock,    "apu.dmc.next_clock");
+    s(frame.five_step,   "apu.frame.five_step");
+    s(frame.irq_inhibit, "apu.frame.irq_inhibit");
+    s(frame.step,        "apu.frame.step");
+    s(frame.start,       "apu.frame.start");
+    s(frame.next_step,   "apu.frame.next_step");
+    s(frame_irq,   "apu.frame_irq");
+    s(dmc_irq,     "apu.dmc_irq");
+    s(time,        "apu.time");
+    s(frame_start, "apu.frame_start");
+    if (s.loading())
+        schedule();
+}
+
+void APU::run()
+{
+    run_until(cpu->cycles());
+}
+
+void APU::end_frame()
+{
+    run_until(cpu->cycles());
+    // when output is disabled, the samples of the last frame are kept
+    if (output_enabled)
+        synth.end_frame(time - frame_start);
+    frame_start = time;
+}
+
+void APU::run_until(unsigned long target)
+{
+    if (target <= time)
+        return;
+    while (frame.next_step <= target) {
+        run_channels(frame.next_step);
+        time = frame.next_step;
+        clock_frame_step();
+    }
+    run_channels(target);
+    time = target;
+    schedule();
+}
+
+// clocks all channels in order, up to and including target.
+void APU::run_channels(unsigned long target)
+{
+    // channels that can't be heard aren't clocked at all
+    const auto skip = [&](unsigned long &next_clock, bool silent) {
+        if (silent && next_clock <= target)
+            next_clock = target + 1;
+    };
+    for (auto &p : pulse)
+        skip(p.next_clock, p.length == 0 || p.muted() || p.env.volume() == 0);
+    skip(triangle.next_clock, triangle.length == 0 || triangle.linear == 0 || triangle.timer < 2);
+    skip(noise.next_clock, noise.length == 0 || noise.env.volume() == 0);
+
+    const unsigned long pulse_period[2] = { (pulse[0].timer + 1ul) * 2, (pulse[1].timer + 1ul) * 2 };
+    const unsigned long triangle_period = triangle.timer + 1ul;
+    for (;;) {
+        unsigned long t = std::min({ pulse[0].next_clock, pulse[1].next_clock, triangle.next_clock,
+                                     noise.next_clock, dmc.next_clock });
+        if (t > target)
+            break;
+        for (int i = 0; i < 2; i++) {
+            if (pulse[i].next_clock == t) {
+                pulse[i].step = (pulse[i].step + 1) & 7;
+                pulse[i].next_clock += pulse_period[i];
+            }
+        }
+        if (triangle.next_clock == t) {
+            triangle.step = (triangle.step + 1) & 31;
+            triangle.next_clock += triangle_period;
+        }
+        if (noise.next_clock == t) {
+            u16 feedback = (noise.shift ^ (noise.shift >> (noise.mode ? 6 : 1))) & 1;
+            noise.shift = (noise.shift >> 1) | (feedback << 14);
+            noise.next_clock += noise.period;
+        }
+        if (dmc.next_clock == t) {
+            dmc_clock();
+            dmc.next_clock += dmc.period;
+        }
+        update_output(t);
+    }
+}
+
+void APU::clock_frame_step()
+{
+    if (frame.five_step) {
+        switch (frame.step) {
+        case 0: case 2: clock_quarter_frame(); break;
+        case 1: case 4: clock_quarter_frame(); clock_half_frame(); break;
+        }
+    } else {
+        switch (frame.step) {
+        case 0: case 2: clock_quarter_frame(); break;
+        case 1:         clock_quarter_frame(); clock_half_frame(); break;
+        case 3:
+            clock_quarter_frame();
+            clock_half_frame();
+            if (!frame.irq_inhibit) {
+                frame_irq = true;
+                update_irq();
+            }
+            break;
+        }
+    }
+    update_output(time);
+    if (frame.step == (frame.five_step ? 4u : 3u)) {
+        frame.start += frame_length[frame.five_step];
+        frame.step = 0;
+    } else
+        frame.step++;
+    frame.next_step = frame.start + frame_steps[frame.five_step][frame.step];
+}
+
+void APU::clock_quarter_frame()
+{
+    pulse[0].env.clock();
+    pulse[1].env.clock();
+    noise.env.clock();
+    if (triangle.linear_reload_flag)
+        triangle.linear = triangle.linear_reload;
+    else if (triangle.linear > 0)
+        triangle.linear--;
+    if (!triangle.control)
+        triangle.linear_reload_flag = false;
+}
+
+void APU::clock_half_frame()
+{
+    for (auto &p : pulse) {
+        if (!p.env.loop && p.length > 0)
+            p.length--;
+        p.clock_sweep();
+    }
+    if (!triangle.control && triangle.length > 0)
+        triangle.length--;
+    if (!noise.env.loop && noise.length > 0)
+        noise.length--;
+}
+
+void APU::dmc_clock()
+{
+    if (!dmc.silence) {
+        if (dmc.shift & 1) {
+            if (dmc.level <= 125)
+                dmc.level += 2;
+        } else if (dmc.level >= 2)
+            dmc.level -= 2;
+    }
+    dmc.shift >>= 1;
+    if (--dmc.bits_left == 0) {
+        dmc.bits_left = 8;
+        dmc.silence = !dmc.buffer_full;
+        if (dmc.buffer_full) {
+            dmc.shift = dmc.buffer;
+            dmc.buffer_full = false;
+            dmc_fetch();
+        }
+    }
+}
+
+void APU::dmc_fetch()
+{
+    if (dmc.buffer_full || dmc.bytes_left == 0)
+        return;
+    cpu->stall(4);
+    dmc.buffer = bus->read(dmc.addr);
+    dmc.buffer_full = true;
+    dmc.addr = dmc.addr == 0xFFFF ? 0x8000 : dmc.addr + 1;
+    if (--dmc.bytes_left == 0) {
+        if (dmc.loop)
+            dmc_restart();
+        else if (dmc.irq_enabled) {
+            dmc_irq = true;
+            update_irq();
+        }
+    }
+}
+
+void APU::dmc_restart()
+{
+    dmc.addr       = dmc.sample_addr;
+    dmc.bytes_left = dmc.sample_length;
+}
+
+void APU::update_irq()
+{
+    cpu->set_irq(IRQSource::APUFrame, frame_irq);
+    cpu->set_irq(IRQSource::DMC, dmc_irq);
+}
+
+void APU::update_output(unsigned long at)
+{
+    if (!output_enabled)
+        return;
+    float out = mix_tables.pulse[pulse[0].output() + pulse[1].output()]
+              + mix_tables.tnd[3 * triangle.output() + 2 * noise.output() + dmc.level];
+    synth.update(at - frame_start, out);
+}
+
+// finds out when the APU must next catch up with the CPU: that's either
+// the frame IRQ or the next time the DMC reads memory.
+void APU::schedule()
+{
+    event_time = NEVER;
+    if (!frame.five_step && !frame.irq_inhibit && !frame_irq)
+        event_time = frame.start + frame_steps[0][3];
+    if (dmc.bytes_left > 0)
+        event_time = std::min(event_time, dmc.next_clock + (dmc.bits_left - 1ul) * dmc.period);
+}
+
+u8 APU::readreg(u16 addr)
+{
+    if (addr != 0x4015)
+        return 0;
+    run();
+    u8 data = (pulse[0].length > 0)     << 0
+            | (pulse[1].length > 0)     << 1
+            | (triangle.length > 0)     << 2
+            | (noise.length > 0)        << 3
+            | (dmc.bytes_left > 0)      << 4
+            | frame_irq                 << 6
+            | dmc_irq                   << 7;
+    frame_irq = false;
+    update_irq();
+    schedule();
+    return data;
+}
+
+void APU::writereg(u16 addr, u8 data)
+{
+    run();
+    switch (addr) {
+    case 0x4000: case 0x4004: {
+        auto &p = pulse[(addr >> 2) & 1];
+        p.duty         = data >> 6;
+        p.env.loop     = data >> 5 & 1;
+        p.env.constant = data >> 4 & 1;
+        p.env.period   = data & 0xF;
+        break;
+    }
+    case 0x4001: case 0x4005: {
+        auto &p = pulse[(addr >> 2) & 1];
+        p.sweep_enabled = data >> 7;
+        p.sweep_period  = data >> 4 & 7;
+        p.sweep_negate  = data >> 3 & 1;
+        p.sweep_shift   = data & 7;
+        p.sweep_reload  = true;
+        break;
+    }
+    case 0x4002: case 0x4006: {
+        auto &p = pulse[(addr >> 2) & 1];
+        p.timer = (p.timer & 0x700) | data;
+        break;
+    }
+    case 0x4003: case 0x4007: {
+        auto &p = pulse[(addr >> 2) & 1];
+        p.timer = (p.timer & 0xFF) | (data & 7) << 8;
+        if (p.enabled)
+            p.length = length_table[data >> 3];
+        p.step = 0;
+        p.env.start = true;
+        break;
+    }
+    case 0x4008:
+        triangle.control       = data >> 7;
+        triangle.linear_reload = data & 0x7F;
+        break;
+    case 0x400A:
+        triangle.timer = (triangle.timer & 0x700) | data;
+        break;
+    case 0x400B:
+        triangle.timer = (triangle.timer & 0xFF) | (data & 7) << 8;
+        if (triangle.enabled)
+            triangle.length = length_table[data >> 3];
+        triangle.linear_reload_flag = true;
+        break;
+    case 0x400C:
+        noise.env.loop     = data >> 5 & 1;
+        noise.env.constant = data >> 4 & 1;
+        noise.env.period   = data & 0xF;
+        break;
+    case 0x400E:
+        noise.mode   = data >> 7;
+        noise.period = noise_table[data & 0xF];
+        break;
+    case 0x400F:
+        if (noise.enabled)
+            noise.length = length_table[data >> 3];
+        noise.env.start = true;
+        break;
+    case 0x4010:
+        dmc.irq_enabled = data >> 7;
+        dmc.loop        = data >> 6 & 1;
+        dmc.period      = dmc_table[data & 0xF];
+        if (!dmc.irq_enabled) {
+            dmc_irq = false;
+            update_irq();
+        }
+        break;
+    case 0x4011:
+        dmc.level = data & 0x7F;
+        break;
+    case 0x4012:
+        dmc.sample_addr = 0xC000 | u16(data) << 6;
+        break;
+    case 0x4013:
+        dmc.sample_length = u16(data) << 4 | 1;
+        break;
+    case 0x4015:
+        pulse[0].enabled = data & 1;
+        pulse[1].enabled = data & 2;
+        triangle.enabled = data & 4;
+        noise.enabled    = data & 8;
+        for (auto &p : pulse)
+            if (!p.enabled)
+                p.length = 0;
+        if (!triangle.enabled)
+            triangle.length = 0;
+        if (!noise.enabled)
+            noise.length = 0;
+        if (!(data & 0x10))
+            dmc.bytes_left = 0;
+        else if (dmc.bytes_left == 0) {
+            dmc_restart();
+            dmc_fetch();
+        }
+        dmc_irq = false;
+        update_irq();
+        break;
+    case 0x4017:
+        frame.five_step   = data >> 7;
+        frame.irq_inhibit = data >> 6 & 1;
+        if (frame.irq_inhibit) {
+            frame_irq = false;
+            update_irq();
+        }
+        // the sequencer restarts 3 or 4 cycles after the write
+        frame.start     = time + 3 + (time & 1);
+        frame.step      = 0;
+        frame.next_step = frame.start + frame_steps[frame.five_step][0];
+        if (frame.five_step) {
+            clock_quarter_frame();
+            clock_half_frame();
+        }
+        break;
+    }
+    update_output(time);
+    schedule();
+}
+
+} // namespace core
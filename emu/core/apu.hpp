@@ -0,0 +1,191 @@
+#pragma once
+
+#include <array>
+#include <span>
+#include <vector>
+#include <emu/core/const.hpp>
+#include <emu/core/bus.hpp>
+#include <emu/util/common.hpp>
+#include <emu/util/serializer.hpp>
+
+/*
+ * The APU (the audio half of the 2A03). It has five channels: two pulse
+ * waves, a triangle wave, noise and a delta modulation channel (DMC) which
+ * plays samples from memory; a frame sequencer clocks their envelopes,
+ * sweeps and length counters and can raise IRQs.
+ * The APU isn't stepped every CPU cycle. Instead it catches up to the CPU
+ * when one of its registers is accessed, when the next event that affects
+ * the CPU comes (an IRQ or a DMC memory read, see next_event()) and at the
+ * end of every frame. Inside a batch, each channel jumps straight from one
+ * timer clock to the next.
+ * Every time the mixed output changes, a band-limited step is added to the
+ * sample buffer (see Synth), which is turned into the samples for the
+ * current frame by end_frame().
+ */
+
+namespace core {
+
+class CPU;
+
+// band-limited step synthesis. steps are added at a time in CPU cycles,
+// relative to the start of the frame.
+class Synth {
+public:
+    static constexpr int PHASES = 32;
+    static constexpr int WIDTH  = 16;
+
+private:
+    std::vector<float> buf;
+    std::vector<i16> out;
+    double factor = 0;          // samples per CPU cycle
+    double offset = 0;          // fraction of sample carried over from the last frame
+    float level = 0;            // the output level the synth is at
+    float integrator = 0;
+    float hp_prev_in = 0, hp_prev_out = 0;
+
+public:
+    void set_rate(double clock_rate, unsigned sample_rate);
+    void clear();
+    void update(unsigned long time, float new_level);
+    void end_frame(unsigned long duration);
+    std::span<const i16> samples() const { return out; }
+};
+
+class APU {
+    struct Envelope {
+        bool start = false;
+        bool loop = false;
+        bool constant = false;
+        u8 period = 0;
+        u8 divider = 0;
+        u8 decay = 0;
+
+        void clock();
+        u8 volume() const { return constant ? period : decay; }
+    };
+
+    struct Pulse {
+        Envelope env;
+        bool enabled = false;
+        u8 duty = 0;
+        u8 step = 0;
+        u8 length = 0;
+        u16 timer = 0;
+        unsigned long next_clock = 0;
+        bool sweep_enabled = false;
+        bool sweep_negate = false;
+        bool sweep_reload = false;
+        u8 sweep_period = 0;
+        u8 sweep_shift = 0;
+        u8 sweep_divider = 0;
+        bool ones_complement = false;   // pulse 1 negates differently
+
+        u16 sweep_target() const;
+        bool muted() const { return timer < 8 || sweep_target() > 0x7FF; }
+        void clock_sweep();
+        u8 output() const;
+    };
+
+    struct Triangle {
+        bool enabled = false;
+        bool control = false;
+        u8 linear_reload = 0;
+        u8 linear = 0;
+        bool linear_reload_flag = false;
+        u8 step = 0;
+        u8 length = 0;
+        u16 timer = 0;
+        unsigned long next_clock = 0;
+
+        u8 output() const;
+    };
+
+    struct Noise {
+        Envelope env;
+        bool enabled = false;
+        bool mode = false;
+        u16 period = 4;
+        u16 shift = 1;
+        u8 length = 0;
+        unsigned long next_clock = 0;
+
+        u8 output() const { return length == 0 || (shift & 1) ? 0 : env.volume(); }
+    };
+
+    struct DMC {
+        bool irq_enabled = false;
+        bool loop = false;
+        u16 period = 428;
+        u8 level = 0;
+        u16 sample_addr = 0xC000;
+        u16 sample_length = 1;
+        u16 addr = 0xC000;
+        u16 bytes_left = 0;
+        u8 buffer = 0;
+        bool buffer_full = false;
+        u8 shift = 0;
+        u8 bits_left = 8;
+        bool silence = true;
+        unsigned long next_clock = 0;
+    };
+
+    Bus<CPUBUS_SIZE> *bus;
+    CPU *cpu;
+    Synth synth;
+
+    std::array<Pulse, 2> pulse;
+    Triangle triangle;
+    Noise noise;
+    DMC dmc;
+
+    struct {
+        bool five_step = false;
+        bool irq_inhibit = false;
+        unsigned step = 0;
+        unsigned long start = 0;        // when the sequence started
+        unsigned long next_step = 0;
+    } frame;
+
+    bool frame_irq = false;
+    bool dmc_irq = false;
+    unsigned long time = 0;         // the CPU cycle the APU has caught up to
+    unsigned long frame_start = 0;  // the CPU cycle the current frame started at
+    unsigned long event_time = 0;
+    bool output_enabled = true;
+    unsigned rate = 0;
+
+    void run_until(unsigned long target);
+    void run_channels(unsigned long target);
+    void clock_frame_step();
+    void clock_quarter_frame();
+    void clock_half_frame();
+    void dmc_clock();
+    void dmc_fetch();
+    void dmc_restart();
+    void update_irq();
+    void update_output(unsigned long at);
+    void schedule();
+
+public:
+    static constexpr unsigned DEFAULT_SAMPLE_RATE = 48000;
+
+    APU(Bus<CPUBUS_SIZE> *b, CPU *c) : bus(b), cpu(c) { set_sample_rate(DEFAULT_SAMPLE_RATE); }
+
+    void power(bool reset);
+    u8 readreg(u16 addr);
+    void writereg(u16 addr, u8 data);
+    void serialize(util::Serializer &s);
+
+    // catches up to the CPU. must be called when the CPU reaches next_event().
+    void run();
+    unsigned long next_event() const { return event_time; }
+    void end_frame();
+
+    void set_sample_rate(unsigned rate);
+    unsigned sample_rate() const { return rate; }
+    void enable_output(bool value) { output_enabled = value; }
+    bool has_output() const { return output_enabled; }
+    std::span<const i16> samples() const { return synth.samples(); }
+};
+
+} // namespace core
@@ -0,0 +1,64 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <emu/core/emulator.hpp>
+#include <emu/util/utility.hpp>
+
+namespace core {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// the nearest-rank percentile of a sorted list
+double percentile(const std::vector<double> &sorted, double p)
+{
+    auto rank = std::size_t(p / 100.0 * sorted.size() + 0.5);
+    return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+
+} // namespace
+
+std::optional<BenchResult> run_benchmark(const Cartridge::Data &cart, unsigned long frames,
+                                         std::string_view movie_path)
+{
+    auto emu = std::make_unique<Emulator>();
+    if (!emu->insert_rom(cart) || (!movie_path.empty() && !emu->play_movie(movie_path)))
+        return std::nullopt;
+    emu->set_headless(true);
+    emu->power();
+
+    BenchResult res;
+    std::vector<double> times;
+    times.reserve(frames);
+    u64 cycles = 0;
+    auto start = Clock::now();
+    while (res.frames < frames && !emu->movie_finished()) {
+        auto t = Clock::now();
+        for (bool done = false; !done; res.instructions++) {
+            // cycles go back to 0 when a movie powers the console off and on
+            unsigned long before = emu->cpu_cycles();
+            done = emu->step();
+            unsigned long after = emu->cpu_cycles();
+            cycles += after >= before ? after - before : after;
+        }
+        times.push_back(std::chrono::duration<double>(Clock::now() - t).count());
+        res.frames++;
+    }
+    res.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    // the PPU runs 3 dots for each CPU cycle
+    res.dots = cycles * 3;
+    if (!times.empty()) {
+        std::sort(times.begin(), times.end());
+        res.p50 = percentile(times, 50);
+        res.p99 = percentile(times, 99);
+        res.max = times.back();
+    }
+    res.peak_rss = util::peak_rss();
+    return res;
+}
+
+} // namespace core
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+#include <emu/core/cartridge.hpp>
+#include <emu/util/uint.hpp>
+
+/*
+ * Headless benchmark. A ROM is run on its own instance, with no frontend,
+ * no audio and no pacing, for a number of frames (or until a movie ends)
+ * while the time taken by each frame is measured. Output is still rendered
+ * into the framebuffer, since that's part of the cost of a frame.
+ */
+
+namespace core {
+
+struct BenchResult {
+    unsigned long frames = 0;
+    double seconds = 0;
+    u64 instructions = 0;   // CPU steps: instructions, interrupts and OAM DMA
+    u64 dots = 0;           // PPU cycles
+    double p50 = 0;         // frame times, in seconds
+    double p99 = 0;
+    double max = 0;
+    long peak_rss = 0;      // of the whole process, in KiB
+};
+
+// movie_path may be empty, in which case there's no input.
+std::optional<BenchResult> run_benchmark(const Cartridge::Data &cart, unsigned long frames,
+                                         std::string_view movie_path);
+
+} // namespace core
@@ -14,7 +14,8 @@ class Bus {
     using Reader = std::function<u8(u16)>;
     using Writer = std::function<void(u16, u8)>;
 
-    std::array<unsigned, BusSize> lookup;
+    // ids fit in a byte, which keeps the table in 64 KiB for the CPU bus
+    std::array<u8, BusSize> lookup;
     Reader readtab[TABSIZE];
     Writer writetab[TABSIZE];
     bool assigned[TABSIZE];
@@ -1,8 +1,10 @@
 #include "cartridge.hpp"
 
 #include <fmt/core.h>
+#include <emu/core/gamedb.hpp>
 #include <emu/util/io.hpp>
 #include <emu/util/bits.hpp>
+#include <emu/util/crc32.hpp>
 
 using bits::getbits;
 using bits::getbit;
@@ -14,7 +16,7 @@ std::string Cartridge::Data::to_string() const
 {
     return fmt::format(
         "{}: {}, mapper {}, {}x16k PRG ROM, {}x8k CHR ROM, "
-        "{} CHR RAM, {}-Mirror{}{}",
+        "{} CHR RAM, {}-Mirror{}{}{}",
         filename,
         format == Format::iNES ? "iNES" : "NES 2.0",
         mapper,
@@ -23,7 +25,8 @@ std::string Cartridge::Data::to_string() const
         has.chrram ? chrram_size : 0,
         mirroring == Mirroring::Horizontal ? 'H' : mirroring == Mirroring::Vertical ? 'V' : 'O',
         has.battery ? ", contains SRAM" : "",
-        has.trainer ? ", contains Trainer" : ""
+        has.trainer ? ", contains Trainer" : "",
+        fixed_header ? ", header fixed from database" : ""
     );
 }
 
@@ -38,6 +41,8 @@ std::optional<Cartridge::Data> parse_cartridge(io::MappedFile &romfile)
     int start = 0;
     auto read = [&](std::size_t len) { auto tmp = start; start += len; return romfile.slice(tmp, len); };
 
+    if (romfile.size() < Cartridge::HEADER_SIZE)
+        return std::nullopt;
     cart.header = read(16);
     if (std::memcmp(cart.header.data(), constants, sizeof(constants)) != 0)
         return std::nullopt;
@@ -82,10 +87,12 @@ std::optional<Cartridge::Data> parse_cartridge(io::MappedFile &romfile)
         data.submapper      = getbits(cart.header[8], 4, 4);
         prgrom_size         = getbits(cart.header[9], 0, 4) << 8 | prgrom_size;
         chrrom_size         = getbits(cart.header[9], 4, 4) << 8 | chrrom_size;
-        data.prgram_size    = 64 << getbits(cart.header[10], 0, 4);
-        data.prg_nvram_size = 64 << getbits(cart.header[10], 4, 4);
-        cart.chrram_size    = 64 << getbits(cart.header[11], 0, 4);
-        data.chr_nvram_size = 64 << getbits(cart.header[11], 4, 4);
+        // sizes are 64 << n bytes, except that 0 means none
+        const auto ram_size = [](u32 n) -> u32 { return n == 0 ? 0 : 64 << n; };
+        data.prgram_size    = ram_size(getbits(cart.header[10], 0, 4));
+        data.prg_nvram_size = ram_size(getbits(cart.header[10], 4, 4));
+        cart.chrram_size    = ram_size(getbits(cart.header[11], 0, 4));
+        data.chr_nvram_size = ram_size(getbits(cart.header[11], 4, 4));
         data.timing_mode    = getbits(cart.header[12], 0, 2);
         if (cart.console_type == Cartridge::Console::VsSystem) {
             data.vs_ppu      = getbits(cart.header[13], 0, 4);
@@ -99,11 +106,25 @@ std::optional<Cartridge::Data> parse_cartridge(io::MappedFile &romfile)
         cart.nes20_data = data;
     }
 
+    // a truncated file would have us read past its end
+    std::size_t total = Cartridge::HEADER_SIZE + (cart.has.trainer ? Cartridge::TRAINER_SIZE : 0)
+                      + std::size_t(prgrom_size) * 16_KiB + (cart.has.chrram ? 0 : std::size_t(chrrom_size) * 8_KiB);
+    if (romfile.size() < total)
+        return std::nullopt;
     if (cart.has.trainer)
         cart.trainer = read(512);
     cart.prgrom = read(prgrom_size * 16_KiB);
     if (!cart.has.chrram)
-        cart.chrrom = read(chrrom_size * 18_KiB);
+        cart.chrrom = read(chrrom_size * 8_KiB);
+
+    cart.crc = util::crc32(cart.chrrom, util::crc32(cart.prgrom));
+    cart.fixed_header = false;
+    if (const auto *fix = find_header_fix(cart.crc)) {
+        cart.mapper      = fix->mapper.value_or(cart.mapper);
+        cart.mirroring   = fix->mirroring.value_or(cart.mirroring);
+        cart.has.battery = fix->battery.value_or(cart.has.battery);
+        cart.fixed_header = true;
+    }
     return cart;
 }
 
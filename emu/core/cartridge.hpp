@@ -35,6 +35,8 @@ namespace Cartridge {
         std::span<u8> chrrom;
         std::span<u8> header;
         std::span<u8> trainer;
+        u32 crc;                // of PRG ROM followed by CHR ROM
+        bool fixed_header;      // some fields come from the game database
 
         struct {
             bool battery;
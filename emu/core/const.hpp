@@ -32,6 +32,9 @@ enum {
     SCREEN_HEIGHT   = 240,
     PPU_MAX_LINES   = 262,
     PPU_MAX_LCYCLE  = 341,
+
+    // NTSC CPU clock rate, in Hz. the APU runs at half of it.
+    CPU_CLOCK_RATE  = 1789773,
 };
 
 enum class Mirroring {
@@ -39,6 +42,7 @@ enum class Mirroring {
     Horizontal,
     FourScreen,
     OneScreen,
+    OneScreenHigh,
     Mapper,
 };
 
@@ -1,7 +1,5 @@
 #include "controller.hpp"
 
-#include <emu/program.hpp>
-
 using input::Button;
 
 namespace core {
@@ -9,7 +7,7 @@ namespace core {
 u8 Gamepad::read()
 {
     if (latched == 1)
-        return program.poll_input()[Button::A];
+        return bool(keys[Button::A]) | bool(hold_buttons[Button::A]);
     auto bit = buttons & 1;
     buttons >>= 1;
     return bit;
@@ -20,15 +18,21 @@ void Gamepad::latch(bool state)
     if (latched == state)
         return;
     latched = state;
-    // poll input only when we switch to serial mode
+    // latch the buttons only when we switch to serial mode
     if (latched == 0) {
-        auto curr_keys = program.poll_input();
         for (auto button : { Button::Right, Button::Left,   Button::Down, Button::Up,
                              Button::Start, Button::Select, Button::B,    Button::A }) {
             buttons <<= 1;
-            buttons |= bool(curr_keys[button]) | bool(hold_buttons[button]);
+            buttons |= bool(keys[button]) | bool(hold_buttons[button]);
         }
     }
 }
 
+void Gamepad::serialize(util::Serializer &s)
+{
+    s(latched, "gamepad.latched");
+    s(buttons, "gamepad.buttons");
+    s(keys,    "gamepad.keys");
+}
+
 } // namespace core
@@ -3,6 +3,7 @@
 #include <memory>
 #include <emu/util/debug.hpp>
 #include <emu/util/uint.hpp>
+#include <emu/util/serializer.hpp>
 #include <emu/backend/input.hpp>
 
 /*
@@ -19,6 +20,7 @@ namespace core {
 
 struct Controller {
 protected:
+    input::Keys keys;
     input::Keys hold_buttons;
 public:
     enum class Type {
@@ -27,16 +29,22 @@ public:
     virtual ~Controller() = default;
     virtual u8 read() = 0;
     virtual void latch(bool state) = 0;
+    virtual void serialize(util::Serializer &s) = 0;
 
+    // sets the buttons currently held by the player. the emulator calls this
+    // once per frame, so that input can't change in the middle of one.
+    void set_keys(input::Keys k) { keys = k; }
+    input::Keys get_keys() const { return keys; }
     void hold(input::Button button, bool value) { hold_buttons[button] = value; }
 };
 
 class Gamepad : public Controller {
     bool latched = 0;
-    u8 buttons;
+    u8 buttons = 0;
 public:
     u8 read();
     void latch(bool state);
+    void serialize(util::Serializer &s);
 };
 
 struct ControllerPort {
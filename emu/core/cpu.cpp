@@ -1,5 +1,7 @@
 #include "cpu.hpp"
 
+#include <emu/core/apu.hpp>
+#include <emu/core/mapper.hpp>
 #include <emu/util/debug.hpp>
 
 namespace core {
@@ -29,6 +31,8 @@ void CPU::power(bool reset)
             bus->write(i, 0);
     }
 
+    // any pending interrupt is lost
+    status = {};
     // reset interrupt
     status.reset_pending = true;
     interrupt();
@@ -60,15 +64,43 @@ void CPU::fire_irq()
     status.irq_pending = true;
 }
 
+void CPU::set_irq(IRQSource source, bool value)
+{
+    status.irq_lines = value ? status.irq_lines |  u8(source)
+                             : status.irq_lines & ~u8(source);
+}
+
 void CPU::fire_nmi()
 {
     status.nmi_pending = true;
 }
 
+void CPU::serialize(util::Serializer &s)
+{
+    s(r.pc,         "cpu.pc");
+    s(r.acc,        "cpu.a");
+    s(r.x,          "cpu.x");
+    s(r.y,          "cpu.y");
+    s(r.sp,         "cpu.sp");
+    s(r.flags.full, "cpu.p");
+    s(status,       "cpu.status");
+    s(dma,          "cpu.dma");
+    s(cpu_cycles,   "cpu.cycles");
+}
+
+// most reads are opcodes and operands from ROM: these, and PRG RAM, go
+// straight to the mapper, which gets inlined here.
+inline u8 CPU::busread(u16 addr)
+{
+    if (addr >= 0x6000 && mapper)
+        return addr >= 0x8000 ? mapper->read_rom(addr) : mapper->read_wram(addr);
+    return bus->read(addr);
+}
+
 u8 CPU::fetch()
 {
     cycle();
-    return bus->read(r.pc.v++);
+    return busread(r.pc.v++);
 }
 
 void CPU::run_instr(u8 id, u8 low, u8 high)
@@ -272,7 +304,7 @@ void CPU::interrupt()
     } else if (status.nmi_pending) {
         status.nmi_pending = false;
         vec = NMI_VEC;
-    } else if (status.irq_pending) {
+    } else if (status.irq_pending || status.irq_lines) {
         status.irq_pending = false;
         vec = IRQ_BRK_VEC;
     } else
@@ -307,7 +339,7 @@ void CPU::last_cycle()
 
 void CPU::irqpoll()
 {
-    if (!status.exec_irq && !r.flags.intdis && status.irq_pending)
+    if (!status.exec_irq && !r.flags.intdis && (status.irq_pending || status.irq_lines))
         status.exec_irq = true;
 }
 
@@ -320,13 +352,16 @@ void CPU::nmipoll()
 u8 CPU::readmem(u16 addr)
 {
     cycle();
-    return bus->read(addr);
+    return busread(addr);
 }
 
 void CPU::writemem(u16 addr, u8 data)
 {
     cycle();
-    bus->write(addr, data);
+    if (addr >= 0x6000 && addr < 0x8000 && mapper)
+        mapper->write_wram(addr, data);
+    else
+        bus->write(addr, data);
 }
 
 /* These two functions read the registers located between 0x4000 - 0x4020. */
@@ -335,12 +370,14 @@ u8 CPU::readreg(u16 addr)
     switch (addr) {
     case 0x4000: case 0x4001: case 0x4002: case 0x4003: case 0x4004: case 0x4005: case 0x4006: case 0x4007:
     case 0x4008: case 0x400A: case 0x400B: case 0x400C: case 0x400E: case 0x400F: case 0x4010: case 0x4011:
-    case 0x4012: case 0x4013: case 0x4014: case 0x4015:
+    case 0x4012: case 0x4013: case 0x4014:
         return 0;
+    case 0x4015:
+        return apu->readreg(addr);
     case 0x4016:
         return port1->device->read();
     case 0x4017:
-        return 0;
+        return port2->device->read();
     default:
         return 0;
     }
@@ -350,76 +387,17 @@ void CPU::writereg(u16 addr, u8 data)
 {
     switch (addr) {
 
-    // SQ1_VOL
-    case 0x4000:
-        break;
-
-    // SQ1_SWEEP
-    case 0x4001:
-        break;
-
-    // SQ1_LO
-    case 0x4002:
-        break;
-
-    // SQ1_HI
-    case 0x4003:
-        break;
-
-    // SQ2_VOL
-    case 0x4004:
-        break;
-
-    // SQ2_SWEEP
-    case 0x4005:
-        break;
-
-    // SQ2_LO
-    case 0x4006:
-        break;
-
-    // SQ2_HI
-    case 0x4007:
-        break;
-
-    // TRI_LINEAR
-    case 0x4008:
-        break;
-
-    // TRI_LO
-    case 0x400A:
-        break;
-
-    // TRI_HI
-    case 0x400B:
-        break;
-
-    // NOISE_VOL
-    case 0x400C:
-        break;
-
-    // NOISE_LO
-    case 0x400E:
-        break;
-
-    // NOISE_HI
-    case 0x400F:
-        break;
-
-    // DMC_FREQ
-    case 0x4010:
-        break;
-
-    // DMC_RAW
-    case 0x4011:
-        break;
-
-    // DMC_START
-    case 0x4012:
-        break;
-
-    // DMC_LEN
-    case 0x4013:
+    // SQ1_VOL, SQ1_SWEEP, SQ1_LO, SQ1_HI
+    case 0x4000: case 0x4001: case 0x4002: case 0x4003:
+    // SQ2_VOL, SQ2_SWEEP, SQ2_LO, SQ2_HI
+    case 0x4004: case 0x4005: case 0x4006: case 0x4007:
+    // TRI_LINEAR, TRI_LO, TRI_HI
+    case 0x4008: case 0x400A: case 0x400B:
+    // NOISE_VOL, NOISE_LO, NOISE_HI
+    case 0x400C: case 0x400E: case 0x400F:
+    // DMC_FREQ, DMC_RAW, DMC_START, DMC_LEN
+    case 0x4010: case 0x4011: case 0x4012: case 0x4013:
+        apu->writereg(addr, data);
         break;
 
     // OAMDMA
@@ -430,15 +408,18 @@ void CPU::writereg(u16 addr, u8 data)
 
     // SND_CHN
     case 0x4015:
+        apu->writereg(addr, data);
         break;
 
-    // JOY1
+    // JOY1, the strobe goes to both ports
     case 0x4016:
         port1->device->latch(data & 1);
+        port2->device->latch(data & 1);
         break;
 
-    // JOY2
+    // frame counter (JOY2 is read only)
     case 0x4017:
+        apu->writereg(addr, data);
         break;
 
     default:
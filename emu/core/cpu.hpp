@@ -6,12 +6,25 @@
 #include <emu/core/controller.hpp>
 #include <emu/util/bits.hpp>
 #include <emu/util/uint.hpp>
+#include <emu/util/serializer.hpp>
 
 namespace debugger { class CPUDebugger; }
 class CPUTest;
+class CPUBench;
 
 namespace core {
 
+class APU;
+struct Mapper;
+
+// devices that can hold the IRQ line. the line stays low for as long as
+// one of them holds it.
+enum class IRQSource : u8 {
+    APUFrame = 1 << 0,
+    DMC      = 1 << 1,
+    Mapper   = 1 << 2,
+};
+
 class CPU {
     struct {
         bits::Word pc{0};
@@ -39,6 +52,7 @@ class CPU {
         bool reset_pending = false;
         bool exec_nmi      = false;
         bool exec_irq      = false;
+        u8 irq_lines       = 0;
     } status;
 
     struct {
@@ -49,28 +63,40 @@ class CPU {
     unsigned long cpu_cycles = 0;
     Bus<CPUBUS_SIZE> *bus = nullptr;
     ControllerPort *port1  = nullptr;
+    ControllerPort *port2  = nullptr;
+    APU *apu               = nullptr;
+    Mapper *mapper         = nullptr;
 
     std::function<void(u8, u16)> error_callback;
 
 public:
-    explicit CPU(Bus<CPUBUS_SIZE> *b, ControllerPort *p) : bus(b), port1(p) { }
+    CPU(Bus<CPUBUS_SIZE> *b, ControllerPort *p1, ControllerPort *p2, APU *a)
+        : bus(b), port1(p1), port2(p2), apu(a)
+    { }
 
     void power(bool reset = false);
     void run();
     u8 readreg(u16 addr);
     void writereg(u16 addr, u8 data);
     void fire_irq();
+    void set_irq(IRQSource source, bool value);
     void fire_nmi();
+    void serialize(util::Serializer &s);
 
     // used for testing. when called, it'll write to the bus the parameters
     // passed and run them, so a valid bus must be set up first.
     void run_instr(u8 id, u8 low, u8 high);
 
     unsigned long cycles() const { return cpu_cycles; }
+    // the DMC stops the CPU while it reads a sample byte
+    void stall(unsigned n)       { cpu_cycles += n; }
     void on_error(auto &&f) { error_callback = f; }
+    // cartridge ROM and RAM are accessed straight from the mapper, without the bus
+    void set_mapper(Mapper *m)   { mapper = m; }
 
     friend class debugger::CPUDebugger;
     friend class ::CPUTest;
+    friend class ::CPUBench;
 
 private:
     u8 fetch();
@@ -82,6 +108,7 @@ private:
     void nmipoll();
     void cycle();
     void last_cycle();
+    u8 busread(u16 addr);
     u8 readmem(u16 addr);
     void writemem(u16 addr, u8 data);
     void oamdma_loop(u8 page);
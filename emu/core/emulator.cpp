@@ -1,6 +1,16 @@
 #include "emulator.hpp"
 
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fmt/core.h>
+#include <unistd.h>
 #include <emu/program.hpp>
+#include <emu/util/bits.hpp>
+#include <emu/util/crc32.hpp>
+
+using namespace bits::literals;
 
 namespace core {
 
@@ -8,49 +18,20 @@ Emulator emulator;
 
 void System::power(bool reset, char fill_value)
 {
+    mapper->power();
     cpu.power(reset);
+    apu.power(reset);
     ppu.power(reset);
-    port.load(Controller::Type::Gamepad);
+    port1.load(Controller::Type::Gamepad);
+    port2.load(Controller::Type::Gamepad);
     std::fill(rammem.begin(), rammem.end(), fill_value);
     if (!reset) {
-        std::fill(vrammem.begin(), vrammem.end(), fill_value);
-        std::fill(palmem.begin(),  palmem.end(), fill_value);
-    }
-}
-
-using VramDecoder = u16 (*)(u16);
-static VramDecoder vram_addr_decoder(Mirroring mirroring)
-{
-    switch (mirroring) {
-    case Mirroring::OneScreen:  return [](u16 addr) -> u16 { return addr & bits::bitmask(10); };
-    case Mirroring::Vertical:   return [](u16 addr) -> u16 { return addr & bits::bitmask(11); };
-    case Mirroring::FourScreen: return [](u16 addr) -> u16 { return addr & bits::bitmask(12); };
-    case Mirroring::Horizontal:
-        return [](u16 addr) -> u16 {
-            auto tmp = addr & 0xFFF;
-            auto bits = bits::getbits(tmp, 10, 2) >> 1;
-            return bits::setbits(tmp, 10, 2, bits);
-        };
-    default:
-        panic("invalid value passed to get_decode\n");
+        std::fill(vrammem.begin(),  vrammem.end(), fill_value);
+        std::fill(cartvram.begin(), cartvram.end(), fill_value);
+        std::fill(palmem.begin(),   palmem.end(), fill_value);
     }
 }
 
-// u16 vram_address(u16 addr, Mirroring mirroring)
-// {
-//     switch (mirroring) {
-//     case Mirroring::OneScreen:  return addr & util::bitmask(10);
-//     case Mirroring::Vertical:   return addr & util::bitmask(11);
-//     case Mirroring::FourScreen: return addr & util::bitmask(12);
-//     case Mirroring::Horizontal: {
-//         auto tmp = addr & 0xFFF;
-//         auto bits = util::getbits(tmp, 10, 2) >> 1;
-//         return util::setbits(tmp, 10, 2, bits);
-//     }
-//     default: panic("");
-//     }
-// }
-
 void System::map(Mirroring mirroring)
 {
     rambus.reset();
@@ -62,28 +43,63 @@ void System::map(Mirroring mirroring)
     rambus.map(0x8000, CPUBUS_SIZE,         [this](u16 addr) { return mapper->read_rom(addr); },     [this](u16 addr, u8 data) { mapper->write_rom(addr, data); });
     vrambus.map(PT_START, NT_START,         [this](u16 addr) { return mapper->read_chr(addr); },     [this](u16 addr, u8 data) { mapper->write_chr(addr, data); });
     vrambus.map(PAL_START, 0x4000,          [this](u16 addr) { return palmem[addr & 0x1F]; },        [this](u16 addr, u8 data) { palmem[addr & 0x1F] = data; });
-    // this->mirroring = mirroring;
-    // vrambus.map(NT_START, PAL_START, [this](u16 addr)          { return vrammem[vram_address(addr, this->mirroring)]; },
-    //                                  [this](u16 addr, u8 data) { vrammem[vram_address(addr, this->mirroring)] = data; });
-    const auto decode = vram_addr_decoder(mirroring);
-    vram_id = vrambus.map(NT_START, PAL_START, [this, decode](u16 addr) { return vrammem[decode(addr)]; },
-                                               [this, decode](u16 addr, u8 data) { vrammem[decode(addr)] = data; });
+    vrambus.map(NT_START, PAL_START,        [this](u16 addr) { return ppu.nametable(addr); },        [this](u16 addr, u8 data) { ppu.nametable(addr) = data; });
+    cpu.set_mapper(mapper.get());
+    ppu.set_mapper(mapper.get());
+    if (mapper->watches_a12())
+        ppu.on_a12([this] { mapper->a12_rise(); });
+    else
+        ppu.on_a12(nullptr);
+    // four-screen carts bring their own 2 KiB of VRAM
+    cartvram = mirroring == Mirroring::FourScreen ? arena.alloc(VRAM_SIZE) : std::span<u8>{};
+    change_mirroring(mirroring);
+}
+
+void System::serialize(util::Serializer &s)
+{
+    cpu.serialize(s);
+    apu.serialize(s);
+    ppu.serialize(s);
+    mapper->serialize(s);
+    port1.device->serialize(s);
+    port2.device->serialize(s);
+    s(rammem,    "ram");
+    s(vrammem,   "vram");
+    if (!cartvram.empty())
+        s.bytes(cartvram.data(), cartvram.size(), "cartvram");
+    s(palmem,    "palette");
+    s(mirroring, "mirroring");
+    if (s.loading())
+        change_mirroring(mirroring);
 }
 
-// void System::change_mirroring(Mirroring mirroring) { this->mirroring = mirroring; }
 void System::change_mirroring(Mirroring mirroring)
 {
-    const auto decode = vram_addr_decoder(mirroring);
-    vrambus.remap(vram_id, [this, decode](u16 addr)          { return vrammem[decode(addr)]; },
-                           [this, decode](u16 addr, u8 data) { vrammem[decode(addr)] = data; });
+    this->mirroring = mirroring;
+    u8 *a = vrammem.data();
+    u8 *b = vrammem.data() + 0x400;
+    switch (mirroring) {
+    case Mirroring::Vertical:      ppu.map_nametables(a, b, a, b); break;
+    case Mirroring::Horizontal:    ppu.map_nametables(a, a, b, b); break;
+    case Mirroring::OneScreen:     ppu.map_nametables(a, a, a, a); break;
+    case Mirroring::OneScreenHigh: ppu.map_nametables(b, b, b, b); break;
+    case Mirroring::FourScreen:
+        ppu.map_nametables(a, b, cartvram.data(), cartvram.data() + 0x400);
+        break;
+    default:
+        panic("invalid mirroring: {}\n", int(mirroring));
+    }
 }
 
 
 Emulator::Emulator()
 {
+    system.port1.load(Controller::Type::Gamepad);
+    system.port2.load(Controller::Type::Gamepad);
     system.ppu.on_nmi([this](bool nmi_enabled) {
         nmi = true;
-        program.video_frame(system.screen.to_span());
+        if (output_enabled && !headless)
+            program.video_frame(system.screen.to_span());
         if (nmi_enabled)
             system.cpu.fire_nmi();
     });
@@ -93,29 +109,365 @@ void System::run()
 {
     unsigned long old_cycle = cpu.cycles();
     cpu.run();
+    if (cpu.cycles() >= apu.next_event())
+        apu.run();
     unsigned long delta = cpu.cycles() - old_cycle;
     // run 3 ppu cycles for 1 cpu cycle
     for (unsigned long i = 0; i < delta*3; i++)
         ppu.run();
 }
 
-void Emulator::run_frame()
+// runs a single instruction. returns true when a frame has been completed.
+bool Emulator::step()
 {
-    while (!nmi && !stopped)
-        system.run();
+    system.run();
+    at_snapshot = false;
+    if (!nmi)
+        return false;
     nmi = false;
+    system.apu.end_frame();
+    if (system.apu.has_output() && !headless)
+        program.audio_frame(system.apu.samples());
+    if (!speculative && frame_callback)
+        frame_callback();
+    if (!speculative)
+        update_input();
+    if (!speculative && savefile && ++frames_since_sync == SAVE_SYNC_FRAMES) {
+        sync_save(false);
+        frames_since_sync = 0;
+    }
+    if (!speculative && rewinder.enabled()) {
+        save_state(rewinder.next_state());
+        rewinder.push();
+        at_snapshot = true;
+    }
+    return true;
+}
+
+void Emulator::run_frame()
+{
+    const auto run_one = [&]() { while (!stopped && !step()) ; };
+    if (runahead_frames == 0) {
+        run_one();
+        return;
+    }
+    // run the real frame without showing it, then run ahead with the same
+    // input and show the last frame. the state is restored at the end, so
+    // for the game the frames we ran ahead never happened.
+    set_output(false);
+    run_one();
+    save_state(runahead_state);
+    bool snapshot = at_snapshot;
+    // sound comes from the real frame instead
+    system.apu.enable_output(false);
+    speculative = true;
+    for (unsigned i = 0; i < runahead_frames; i++) {
+        if (i == runahead_frames - 1)
+            set_output(true);
+        run_one();
+    }
+    speculative = false;
+    system.apu.enable_output(true);
+    load_state(runahead_state);
+    at_snapshot = snapshot;
+}
+
+// runs a frame with the given input on each port. no input is polled and no
+// rewind snapshot is taken: this is for netplay, which handles both itself.
+void Emulator::run_frame(input::Keys p1, input::Keys p2, bool output)
+{
+    system.port1.device->set_keys(p1);
+    system.port2.device->set_keys(p2);
+    set_output(output);
+    system.apu.enable_output(output);
+    speculative = true;
+    while (!stopped && !step())
+        ;
+    speculative = false;
+    set_output(true);
+    system.apu.enable_output(true);
+}
+
+void Emulator::power(bool reset)
+{
+    sync_save();
+    // a reset can come in the middle of a frame (from the debugger), but
+    // movies only have events at the end of a frame. when recording, it's
+    // done there instead, at the same point playback will do it.
+    if (reset) {
+        if (movie.recording())
+            pending_events |= Movie::Event::Reset;
+        else
+            system.power(true);
+        return;
+    }
+    system.power(false);
+    if (movie.recording())
+        pending_events |= Movie::Event::Power;
+    update_input();
+}
+
+// samples the input for the next frame. when playing a movie, input comes
+// from it instead of the player, and the movie may also tell us to power
+// or reset the system.
+void Emulator::update_input()
+{
+    Movie::Frame frame;
+    if (movie.playing()) {
+        if (auto f = movie.next(); f) {
+            frame = f.value();
+            if (frame.events & (Movie::Event::Power | Movie::Event::Reset))
+                system.power(!(frame.events & Movie::Event::Power));
+        } else
+            movie_ended = true;
+    } else
+        frame.keys = booting ? input::Keys{} : program.poll_input();
+    if (movie.recording()) {
+        if (pending_events & Movie::Event::Reset)
+            system.power(true);
+        frame.events = pending_events;
+        pending_events = Movie::Event::None;
+        movie.write(frame);
+    }
+    system.port1.device->set_keys(frame.keys);
+}
+
+bool Emulator::play_movie(std::string_view path)
+{
+    if (!movie.play(path))
+        return false;
+    if (movie.rom_crc() != rom_crc)
+        warning("movie {} was recorded with a different ROM (CRC32 {:08X}, this is {:08X})\n",
+                path, movie.rom_crc(), rom_crc);
+    movie_ended = false;
+    return true;
+}
+
+bool Emulator::record_movie(std::string_view path)
+{
+    pending_events = Movie::Event::None;
+    return movie.record(path, rom_crc);
+}
+
+void Emulator::set_output(bool value)
+{
+    output_enabled = value;
+    system.ppu.enable_output(value);
+}
+
+// the NES 2.0 header tells how much PRG RAM there is. iNES ROMs with a
+// battery get at least 8 KiB, even if the mapper wouldn't have any.
+static std::size_t prgram_size(const Cartridge::Data &cart, std::size_t mapper_default)
+{
+    if (cart.nes20_data) {
+        std::size_t size = cart.nes20_data->prgram_size + cart.nes20_data->prg_nvram_size;
+        if (size != 0)
+            return std::bit_ceil(size);
+    }
+    if (cart.has.battery)
+        return std::max<std::size_t>(mapper_default, 0x2000);
+    return mapper_default;
 }
 
 bool Emulator::insert_rom(const Cartridge::Data &cartdata)
 {
+    sync_save();
+    savefile.reset();
     system.prgrom = cartdata.prgrom;
     system.chrrom = cartdata.chrrom;
+    // the old mapper must go before the arena is emptied. the arena then
+    // gets room for everything the new cartridge needs, plus alignment.
+    system.mapper.reset();
+    system.arena.reset(MAPPER_MAX_SIZE + 8_KiB + 8_KiB + prgram_size(cartdata, 8_KiB) + VRAM_SIZE
+                       + 5 * util::Arena::ALIGN);
     system.mapper = Mapper::create(cartdata.mapper, &system);
+    rom_crc = cartdata.crc;
+    cart_crc = util::crc32(cartdata.header, rom_crc);
+    nmi = false;
+    at_snapshot = false;
+    frames_since_sync = 0;
     if (system.mapper) {
+        if (auto size = prgram_size(cartdata, system.mapper->wram_size()); size != system.mapper->wram_size())
+            system.mapper->resize_wram(size);
         system.map(cartdata.mirroring);
+        rewinder.reset(state_size(), rewind_frames, rewind_bufsize);
+        runahead_state.resize(state_size());
         return true;
     }
     return false;
 }
 
+bool Emulator::use_save_file(std::string_view path)
+{
+    auto size = system.mapper->wram_size();
+    if (size == 0)
+        return false;
+    auto file = io::MappedFile::create(path, size);
+    if (!file)
+        return false;
+    savefile = std::move(file);
+    system.mapper->set_wram({ savefile.value().data(), savefile.value().size() });
+    return true;
+}
+
+void Emulator::sync_save(bool wait)
+{
+    if (savefile)
+        savefile.value().sync(wait);
+}
+
+/*
+ * Boot snapshots are made of a 16 byte header:
+ *     0-3   "YNBS"
+ *     4     version
+ *     5-7   unused
+ *     8-11  CRC32 of the PRG and CHR ROM and of the iNES header
+ *     12-15 CRC32 of the state layout (names, offsets and sizes of fields)
+ * followed by the state. The layout CRC keeps states from other versions of
+ * the emulator from being loaded.
+ */
+namespace {
+
+constexpr char BOOT_MAGIC[] = "YNBS";
+constexpr u8 BOOT_VERSION = 1;
+constexpr std::size_t BOOT_HEADER_SIZE = 16;
+
+void write_u32(u8 *p, u32 x)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = x >> (i * 8);
+}
+
+} // namespace
+
+Emulator::BootInfo Emulator::boot(unsigned frames, std::string_view cache_dir)
+{
+    auto start = std::chrono::steady_clock::now();
+    BootInfo info;
+    auto key = fmt::format("{:08X}-{}", cart_crc, frames);
+    // input for the frames is read at power on and at the end of each one
+    if (movie.playing())
+        key += fmt::format("-m{:08X}", movie.input_crc(frames + 1));
+    if (savefile)
+        key += fmt::format("-s{:08X}", util::crc32({ savefile.value().data(), savefile.value().size() }));
+    // a movie that ends during the boot, or one being recorded, would need
+    // to know what happened in the frames skipped
+    if (!movie.recording() && (!movie.playing() || movie.length() > frames))
+        info.path = (std::filesystem::path(cache_dir) / (key + ".state")).string();
+
+    u8 header[BOOT_HEADER_SIZE] = {};
+    std::memcpy(header, BOOT_MAGIC, 4);
+    header[4] = BOOT_VERSION;
+    write_u32(header + 8, cart_crc);
+    u32 layout_crc = 0;
+    for (const auto &field : state_layout()) {
+        layout_crc = util::crc32({ (const u8 *) field.name.data(), field.name.size() }, layout_crc);
+        u8 pos[8];
+        write_u32(pos, field.offset);
+        write_u32(pos + 4, field.size);
+        layout_crc = util::crc32(pos, layout_crc);
+    }
+    write_u32(header + 12, layout_crc);
+    const auto elapsed = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+
+    if (auto file = io::MappedFile::open(info.path); !info.path.empty() && file
+     && file.value().size() == BOOT_HEADER_SIZE + state_size()
+     && std::memcmp(file.value().data(), header, BOOT_HEADER_SIZE) == 0
+     && load_state(file.value().slice(BOOT_HEADER_SIZE, state_size()))) {
+        movie.seek(frames + 1);
+        info.cached = true;
+        info.seconds = elapsed();
+        return info;
+    }
+
+    if (!movie.playing())
+        system.port1.device->set_keys(input::Keys{});
+    // nothing is shown or heard, just like when the state is loaded
+    set_output(false);
+    system.apu.enable_output(false);
+    booting = true;
+    for (unsigned i = 0; i < frames && !stopped; i++)
+        while (!stopped && !step())
+            ;
+    booting = false;
+    set_output(true);
+    system.apu.enable_output(true);
+    if (!info.path.empty() && !stopped) {
+        // written under another name and renamed, so that other instances
+        // starting at the same time never see half a state
+        std::error_code ec;
+        std::filesystem::create_directories(cache_dir, ec);
+        auto tmppath = fmt::format("{}.{}", info.path, ::getpid());
+        if (auto file = io::MappedFile::create(tmppath, BOOT_HEADER_SIZE + state_size()); file) {
+            std::memcpy(file.value().data(), header, BOOT_HEADER_SIZE);
+            save_state(file.value().slice(BOOT_HEADER_SIZE, state_size()));
+            file.reset();
+            std::filesystem::rename(tmppath, info.path, ec);
+        }
+        if (ec || !std::filesystem::exists(info.path))
+            warning("couldn't write boot state {}\n", info.path);
+    }
+    info.seconds = elapsed();
+    return info;
+}
+
+std::size_t Emulator::state_size()
+{
+    util::Serializer s;
+    system.serialize(s);
+    return s.size();
+}
+
+std::vector<util::Serializer::Field> Emulator::state_layout()
+{
+    std::vector<util::Serializer::Field> layout;
+    util::Serializer s{layout};
+    system.serialize(s);
+    return layout;
+}
+
+void Emulator::save_state(std::span<u8> buf)
+{
+    util::Serializer s{buf};
+    system.serialize(s);
+}
+
+bool Emulator::load_state(std::span<const u8> buf)
+{
+    if (buf.size() != state_size())
+        return false;
+    util::Serializer s{buf};
+    system.serialize(s);
+    return s.ok();
+}
+
+void Emulator::set_rewind(std::size_t frames, std::size_t bufsize)
+{
+    rewind_frames  = frames;
+    rewind_bufsize = bufsize;
+    if (system.mapper)
+        rewinder.reset(state_size(), rewind_frames, rewind_bufsize);
+}
+
+void Emulator::set_runahead(unsigned frames)
+{
+    runahead_frames = frames;
+    if (system.mapper)
+        runahead_state.resize(state_size());
+}
+
+// rewind 1 goes back to the start of the current frame (or to the previous
+// one, if we're right at the start of a frame).
+bool Emulator::rewind(unsigned frames)
+{
+    if (frames == 0)
+        return false;
+    auto state = rewinder.rewind(frames - !at_snapshot);
+    if (!state)
+        return false;
+    load_state(state.value());
+    at_snapshot = true;
+    return true;
+}
+
 } // namespace core
@@ -1,41 +1,57 @@
 #pragma once
 
 #include <array>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <vector>
 #include <span>
 #include <emu/core/bus.hpp>
 #include <emu/core/const.hpp>
 #include <emu/core/cpu.hpp>
+#include <emu/core/apu.hpp>
 #include <emu/core/ppu.hpp>
 #include <emu/core/cartridge.hpp>
 #include <emu/core/screen.hpp>
 #include <emu/core/controller.hpp>
 #include <emu/core/mapper.hpp>
+#include <emu/core/rewind.hpp>
+#include <emu/core/movie.hpp>
+#include <emu/util/arena.hpp>
 #include <emu/util/common.hpp>
+#include <emu/util/io.hpp>
+#include <emu/util/serializer.hpp>
 
 namespace debugger { class Debugger; }
 
 namespace core {
 
 struct System {
+    // memory that depends on the cartridge: the mapper, its RAM and
+    // four-screen VRAM. emptied whenever a ROM is inserted.
+    util::Arena arena;
     Bus<CPUBUS_SIZE> rambus;
     Bus<PPUBUS_SIZE> vrambus;
     Screen screen;
-    ControllerPort port;
-    CPU cpu{&rambus, &port};
+    ControllerPort port1;
+    ControllerPort port2;
+    CPU cpu{&rambus, &port1, &port2, &apu};
+    APU apu{&rambus, &cpu};
     PPU ppu{&vrambus, &screen};
-    std::unique_ptr<Mapper> mapper;
+    util::ArenaPtr<Mapper> mapper;
     std::span<u8> prgrom;
     std::span<u8> chrrom;
     std::array<u8, core::RAM_SIZE> rammem;
     std::array<u8, core::VRAM_SIZE> vrammem;
+    std::span<u8> cartvram;
     std::array<u8, core::PAL_SIZE> palmem;
-    int vram_id = 0;
+    Mirroring mirroring;
 
     void run();
     void power(bool reset, char fill_value = 0);
     void map(Mirroring mirroring);
     void change_mirroring(Mirroring mirroring);
+    void serialize(util::Serializer &s);
 };
 
 class Emulator {
@@ -43,15 +59,97 @@ class Emulator {
     bool nmi = false;
     bool stopped = false;
 
+    Rewinder rewinder;
+    std::size_t rewind_frames = 0;
+    std::size_t rewind_bufsize = 0;
+    bool at_snapshot = false;
+
+    unsigned runahead_frames = 0;
+    std::vector<u8> runahead_state;
+    bool speculative = false;
+    bool output_enabled = true;
+    bool headless = false;
+
+    Movie movie;
+    u32 rom_crc = 0;
+    u32 cart_crc = 0;       // rom_crc and the iNES header
+    u8 pending_events = Movie::Event::None;
+    bool movie_ended = false;
+
+    std::function<void()> frame_callback;
+
+    // battery-backed PRG RAM. changes are written back to the file every
+    // few seconds without waiting for the disk, and waited for at power,
+    // reset, ROM change and exit.
+    static constexpr unsigned SAVE_SYNC_FRAMES = 300;
+    std::optional<io::MappedFile> savefile;
+    unsigned frames_since_sync = 0;
+
+    // boot frames are run without the player's input
+    bool booting = false;
+
+    void set_output(bool value);
+    void update_input();
+
 public:
     Emulator();
 
+    // may be called again to change ROM, followed by power(). buffers that
+    // stay the same size (states, rewind, run-ahead) are reused.
     bool insert_rom(const Cartridge::Data &cartdata);
+    // puts PRG RAM in a save file. must be called after insert_rom.
+    bool use_save_file(std::string_view path);
+    // without wait, the writes are only started, so the caller isn't held
+    // up by the disk
+    void sync_save(bool wait = true);
+
+    struct BootInfo {
+        bool cached = false;    // the state came from the cache
+        std::string path;       // of the cached state, empty if it can't be cached
+        double seconds = 0;
+    };
+    // runs the first frames after power on, with no input or with the
+    // movie's. the state reached is kept in cache_dir, keyed by everything it
+    // depends on (ROM, frames, movie input, save file), and loaded from
+    // there next time: the result is the same as running the frames.
+    // the frames aren't shown. must be called right after power().
+    BootInfo boot(unsigned frames, std::string_view cache_dir);
+
     void run_frame();
+    void run_frame(input::Keys p1, input::Keys p2, bool output);
+    bool step();
+
+    std::size_t state_size();
+    std::vector<util::Serializer::Field> state_layout();
+    void save_state(std::span<u8> buf);
+    bool load_state(std::span<const u8> buf);
+    void set_rewind(std::size_t frames, std::size_t bufsize);
+    bool rewind(unsigned frames);
+    void set_runahead(unsigned frames);
+
+    bool play_movie(std::string_view path);
+    bool record_movie(std::string_view path);
+    void stop_movie()                              { movie.stop(); }
+    bool movie_finished() const                    { return movie_ended; }
+    u32 rom_hash() const                           { return rom_crc; }
 
-    void power(bool reset = false)                 { system.power(reset); }
-    void connect_controller(Controller::Type type) { system.port.load(type); }
+    // power(false) powers on and comes before the first frame. a reset while
+    // recording a movie is put off to the end of the frame.
+    void power(bool reset = false);
+    void connect_controller(Controller::Type type) { system.port1.load(type); }
     void on_cpu_error(auto &&fn)                   { system.cpu.on_error(fn); }
+    // called at the end of every frame that isn't run speculatively
+    void on_frame(auto &&fn)                       { frame_callback = fn; }
+    // frames are still rendered, but never sent to the frontend
+    void set_headless(bool value)                  { headless = value; }
+    std::span<const u8> framebuffer()              { return system.screen.to_span(); }
+    std::span<const u8> ram() const                { return system.rammem; }
+    input::Keys keys(unsigned port) const          { return (port == 1 ? system.port1 : system.port2).device->get_keys(); }
+    // the samples of the last frame that wasn't run speculatively
+    std::span<const i16> audio_samples() const     { return system.apu.samples(); }
+    void set_sample_rate(unsigned rate)            { system.apu.set_sample_rate(rate); }
+    unsigned sample_rate() const                   { return system.apu.sample_rate(); }
+    unsigned long cpu_cycles() const               { return system.cpu.cycles(); }
     void stop()                                    { stopped = true; }
 
     friend class debugger::Debugger;
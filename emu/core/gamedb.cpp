@@ -0,0 +1,45 @@
+#include "gamedb.hpp"
+
+#include <initializer_list>
+
+namespace core {
+
+namespace {
+
+// one line per game, with only the fields that need fixing:
+//     { .crc = 0x12345678, .mirroring = Mirroring::Vertical },
+// entries must come from a verified database; a fix for the wrong CRC
+// breaks a good dump. these come from the header corrections of FCEUX
+// (src/ines-correct.h), which are keyed by the same CRC: UxROM and CNROM
+// games, whose common dumps have the wrong mirroring.
+constexpr std::initializer_list<HeaderFix> fixes = {
+    // UxROM
+    { .crc = 0x9EA1DC76, .mapper = 2, .mirroring = Mirroring::Horizontal },    // Rainbow Islands
+    { .crc = 0x6D65CAC6, .mapper = 2, .mirroring = Mirroring::Horizontal },    // Terra Cresta
+    { .crc = 0xE1B260DA, .mapper = 2, .mirroring = Mirroring::Vertical },      // Argos no Senshi
+    { .crc = 0x266CE198, .mapper = 2, .mirroring = Mirroring::Vertical },      // City Adventure Touch
+    { .crc = 0x804F898A, .mapper = 2, .mirroring = Mirroring::Vertical },      // Dragon Unit
+    { .crc = 0x55773880, .mapper = 2, .mirroring = Mirroring::Vertical },      // Gilligan's Island
+    { .crc = 0x6E0EB43E, .mapper = 2, .mirroring = Mirroring::Vertical },      // Puss 'n Boots
+    { .crc = 0x2BB6A0F8, .mapper = 2, .mirroring = Mirroring::Vertical },      // Sherlock Holmes
+    { .crc = 0x28C11D24, .mapper = 2, .mirroring = Mirroring::Vertical },      // Sukeban Deka 3
+    { .crc = 0x02863604, .mapper = 2, .mirroring = Mirroring::Vertical },      // Sukeban Deka 3
+    { .crc = 0x419461D0, .mapper = 2, .mirroring = Mirroring::Vertical },      // Super Cars
+    // CNROM
+    { .crc = 0xDBF90772, .mapper = 3, .mirroring = Mirroring::Horizontal },    // Alpha Mission
+    { .crc = 0xD858033D, .mapper = 3, .mirroring = Mirroring::Horizontal },    // Armored Scrum Object
+    { .crc = 0x9BDE3267, .mapper = 3, .mirroring = Mirroring::Vertical },      // Adventures of Dino Riki
+    { .crc = 0xD8EFF0DF, .mapper = 3, .mirroring = Mirroring::Vertical },      // Gradius (J)
+    { .crc = 0x1D41CC8C, .mapper = 3, .mirroring = Mirroring::Vertical },      // Gyruss
+};
+
+constexpr auto table = detail::make_table<fixes.size()>(fixes);
+
+} // namespace
+
+const HeaderFix *find_header_fix(u32 crc)
+{
+    return table.find(fixes, crc);
+}
+
+} // namespace core
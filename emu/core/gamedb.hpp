@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <span>
+#include <emu/core/const.hpp>
+#include <emu/util/common.hpp>
+
+/*
+ * Database of games whose common dumps come with a wrong iNES header.
+ * Entries are keyed by the CRC32 of the PRG ROM followed by the CHR ROM
+ * (the hash used by movies and the ROM index) and say which header fields
+ * are to be replaced. The table is a perfect hash built at compile time:
+ * a lookup is a multiply, a shift and one comparison, and nothing is done
+ * at startup.
+ */
+
+namespace core {
+
+struct HeaderFix {
+    u32 crc;
+    std::optional<u16> mapper = std::nullopt;
+    std::optional<Mirroring> mirroring = std::nullopt;
+    std::optional<bool> battery = std::nullopt;
+};
+
+// returns nullptr for games not in the database
+const HeaderFix *find_header_fix(u32 crc);
+
+namespace detail {
+
+// the table is built with hash and displace: keys are split into buckets
+// by one hash, and each bucket gets a seed for a second hash that puts all
+// its keys into free slots. buckets with more keys are placed first, while
+// there's still room. with twice the slots as keys, most buckets take one
+// or two tries. make_table() throws on a duplicate key (or a table it
+// can't build), which makes it a compile error in a constant expression.
+constexpr unsigned bits_for(std::size_t n)
+{
+    unsigned bits = 1;
+    while ((std::size_t(1) << bits) < n)
+        bits++;
+    return bits;
+}
+
+constexpr u32 mix(u32 x)
+{
+    x ^= x >> 16; x *= 0x85EBCA6B;
+    x ^= x >> 13; x *= 0xC2B2AE35;
+    x ^= x >> 16;
+    return x;
+}
+
+template <std::size_t N>
+struct Table {
+    static constexpr unsigned BUCKET_BITS = bits_for(N / 2);
+    static constexpr unsigned SLOT_BITS   = bits_for(N * 2);
+    std::array<u16, 1 << BUCKET_BITS> seeds = {};
+    std::array<u16, 1 << SLOT_BITS>   slots = {};   // index into fixes + 1, 0 = empty
+
+    constexpr unsigned bucket(u32 crc) const        { return (crc * 0x9E3779B1u) >> (32 - BUCKET_BITS); }
+    constexpr unsigned slot(u32 crc, u16 seed) const { return mix(crc ^ seed * 0x27D4EB2Fu) & ((1 << SLOT_BITS) - 1); }
+    constexpr unsigned slot(u32 crc) const           { return slot(crc, seeds[bucket(crc)]); }
+
+    // fixes must be the list the table was built from
+    constexpr const HeaderFix *find(std::span<const HeaderFix> fixes, u32 crc) const
+    {
+        auto i = slots[slot(crc)];
+        if (i == 0)
+            return nullptr;
+        const auto *fix = &fixes[i - 1];
+        return fix->crc == crc ? fix : nullptr;
+    }
+};
+
+template <std::size_t N>
+constexpr Table<N> make_table(std::span<const HeaderFix> list)
+{
+    using T = Table<N>;
+    T table;
+    const HeaderFix *fix = list.data();
+
+    // sort the keys by bucket
+    constexpr std::size_t BUCKETS = 1 << T::BUCKET_BITS;
+    std::array<unsigned, BUCKETS + 1> first = {};
+    for (std::size_t i = 0; i < N; i++)
+        first[table.bucket(fix[i].crc) + 1]++;
+    for (std::size_t b = 0; b < BUCKETS; b++)
+        first[b + 1] += first[b];
+    std::array<unsigned, N> order = {};
+    std::array<unsigned, BUCKETS> fill = {};
+    for (std::size_t i = 0; i < N; i++) {
+        auto b = table.bucket(fix[i].crc);
+        order[first[b] + fill[b]++] = i;
+    }
+
+    unsigned largest = 0;
+    for (std::size_t b = 0; b < BUCKETS; b++)
+        largest = std::max(largest, first[b + 1] - first[b]);
+    if (largest > 32)
+        throw "header fix database: too many keys in one bucket";
+
+    for (unsigned n = largest; n > 0; n--) {
+        for (std::size_t b = 0; b < BUCKETS; b++) {
+            if (first[b + 1] - first[b] != n)
+                continue;
+            for (unsigned k = 0; k < n; k++)
+                for (unsigned j = 0; j < k; j++)
+                    if (fix[order[first[b] + j]].crc == fix[order[first[b] + k]].crc)
+                        throw "header fix database: duplicate CRC";
+            for (u32 seed = 0; ; seed++) {
+                if (seed > 0xFFFF)
+                    throw "header fix database: no seed found";
+                std::array<unsigned, 32> s = {};
+                bool ok = true;
+                for (unsigned k = 0; k < n && ok; k++) {
+                    s[k] = table.slot(fix[order[first[b] + k]].crc, seed);
+                    ok = table.slots[s[k]] == 0;
+                    for (unsigned j = 0; j < k && ok; j++)
+                        ok = s[j] != s[k];
+                }
+                if (!ok)
+                    continue;
+                table.seeds[b] = seed;
+                for (unsigned k = 0; k < n; k++)
+                    table.slots[s[k]] = order[first[b] + k] + 1;
+                break;
+            }
+        }
+    }
+    return table;
+}
+
+} // namespace detail
+
+} // namespace core
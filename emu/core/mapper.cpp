@@ -1,40 +1,89 @@
 #include "mapper.hpp"
 
+#include <algorithm>
 #include <emu/core/emulator.hpp>
 #include <emu/core/const.hpp>
 #include <emu/util/bits.hpp>
 #include <emu/util/debug.hpp>
 
+using namespace bits::literals;
+
 namespace core {
 
-std::unique_ptr<Mapper> Mapper::create(unsigned number, System *s)
+util::ArenaPtr<Mapper> Mapper::create(unsigned number, System *s)
 {
     switch (number) {
-    case 0: return std::make_unique<NROM>(s, s->prgrom, s->chrrom);
-    case 1: return std::make_unique<MMC1>(s, s->prgrom, s->chrrom);
+    case 0:  return s->arena.make<NROM>(s, s->prgrom, s->chrrom);
+    case 1:  return s->arena.make<MMC1>(s, s->prgrom, s->chrrom);
+    case 2:  return s->arena.make<UxROM>(s, s->prgrom, s->chrrom);
+    case 3:  return s->arena.make<CNROM>(s, s->prgrom, s->chrrom);
+    case 4:  return s->arena.make<MMC3>(s, s->prgrom, s->chrrom);
+    case 7:  return s->arena.make<AxROM>(s, s->prgrom, s->chrrom);
+    case 66: return s->arena.make<GxROM>(s, s->prgrom, s->chrrom);
     default: return nullptr;
     }
 }
 
-u8 MMC1::read(std::span<u8> rom, u16 addr, u5 *bank, u1 mode, u8 magic_start)
+Mapper::Mapper(System *s, std::span<u8> prg, std::span<u8> chrmem)
+    : system(s), prgrom(prg), chrrom(chrmem)
+{
+    if (chrrom.empty())
+        chrram = system->arena.alloc(8_KiB);
+    chr = chrrom.empty() ? chrram : chrrom;
+}
+
+void Mapper::resize_wram(std::size_t size)
+{
+    wram = system->arena.alloc(size);
+}
+
+void Mapper::map_prg(unsigned first, unsigned n, int bank)
 {
-    u8 magic        = magic_start - mode;
-    size_t offset   = addr & bits::bitmask(magic);
-    u1 index        = bits::getbit(addr, magic);
-    size_t start    = bank[index] << magic;
-    return rom[start + offset];
+    std::size_t size  = n * 8_KiB;
+    std::size_t banks = std::max<std::size_t>(prgrom.size() / size, 1);
+    std::size_t start = (bank < 0 ? banks + bank : bank % banks) * size;
+    // smaller ROMs are mirrored
+    for (unsigned i = 0; i < n; i++)
+        prg_window[first + i] = &prgrom[(start + i * 8_KiB) % prgrom.size()];
 }
 
-u8 MMC1::read_rom(u16 addr)
+void Mapper::map_chr(unsigned first, unsigned n, int bank)
+{
+    std::size_t size  = n * 1_KiB;
+    std::size_t banks = std::max<std::size_t>(chr.size() / size, 1);
+    std::size_t start = (bank < 0 ? banks + bank : bank % banks) * size;
+    for (unsigned i = 0; i < n; i++)
+        chr_window[first + i] = &chr[(start + i * 1_KiB) % chr.size()];
+}
+
+void Mapper::serialize(util::Serializer &s)
+{
+    if (!chrram.empty())
+        s.bytes(chrram.data(), chrram.size(), "chrram");
+    if (!wram.empty())
+        s.bytes(wram.data(), wram.size(), "wram");
+}
+
+
+
+MMC1::MMC1(System *s, std::span<u8> prg, std::span<u8> chr) : Mapper(s, prg, chr)
 {
-    // 0, 1 -> 1; 2 -> 0; 3 -> 2
-    int displacement = (prg.mode & 2) == 0 ? 1 : (prg.mode & 1) << 1;
-    return read(prgrom, addr, &prg.bank[displacement], prg.mode >> 1, 15);
+    resize_wram(8_KiB);
+    update_banks();
 }
 
-u8 MMC1::read_chr(u16 addr)
+void MMC1::update_banks()
 {
-    return read(chrrom, addr, chr.bank, chr.mode, 13);
+    switch (control >> 2 & 3) {
+    case 0: case 1: prg32(prg_bank >> 1); break;
+    case 2: prg16(0, 0);        prg16(1, prg_bank); break;
+    case 3: prg16(0, prg_bank); prg16(1, -1);       break;
+    }
+    if (control & 0x10) {
+        chr4(0, chr_bank[0]);
+        chr4(1, chr_bank[1]);
+    } else
+        chr8(chr_bank[0] >> 1);
 }
 
 void MMC1::write_rom(u16 addr, u8 data)
@@ -44,6 +93,8 @@ void MMC1::write_rom(u16 addr, u8 data)
 
     if (reset) {
         shift = counter = 0;
+        control = control | 0x0C;
+        update_banks();
         return;
     }
 
@@ -52,23 +103,148 @@ void MMC1::write_rom(u16 addr, u8 data)
         unsigned regno = bits::getbits(addr, 13, 2);
         switch (regno) {
         case 0: {
-            prg.mode = bits::getbits(shift, 2, 2);
-            chr.mode = bits::getbits(shift, 4, 1);
+            control = shift;
             u2 mirroring = bits::getbits(shift, 0, 2);
             switch (mirroring) {
-            case 0: case 1: system->change_mirroring(Mirroring::OneScreen);  break;
-            case 2:         system->change_mirroring(Mirroring::Vertical);   break;
-            case 3:         system->change_mirroring(Mirroring::Horizontal); break;
+            case 0: system->change_mirroring(Mirroring::OneScreen);     break;
+            case 1: system->change_mirroring(Mirroring::OneScreenHigh); break;
+            case 2: system->change_mirroring(Mirroring::Vertical);      break;
+            case 3: system->change_mirroring(Mirroring::Horizontal);    break;
             }
             break;
         }
-        case 1: chr.bank[0] = shift; break;
-        case 2: chr.bank[1] = shift; break;
-        case 3: prg.bank[1] = prg.bank[2] = shift; break;
+        case 1: chr_bank[0] = shift; break;
+        case 2: chr_bank[1] = shift; break;
+        case 3: prg_bank    = shift; break;
         }
         shift = 0;
         counter = 0;
+        update_banks();
+    }
+}
+
+void MMC1::serialize(util::Serializer &s)
+{
+    Mapper::serialize(s);
+    s(counter,  "mmc1.counter");
+    s(shift,    "mmc1.shift");
+    s(control,  "mmc1.control");
+    s(chr_bank, "mmc1.chr_bank");
+    s(prg_bank, "mmc1.prg_bank");
+    if (s.loading())
+        update_banks();
+}
+
+
+
+void UxROM::serialize(util::Serializer &s)
+{
+    Mapper::serialize(s);
+    s(bank, "uxrom.bank");
+    if (s.loading())
+        update_banks();
+}
+
+void CNROM::serialize(util::Serializer &s)
+{
+    Mapper::serialize(s);
+    s(bank, "cnrom.bank");
+    if (s.loading())
+        update_banks();
+}
+
+void AxROM::update_banks()
+{
+    prg32(reg & 7);
+    chr8(0);
+    system->change_mirroring(reg & 0x10 ? Mirroring::OneScreenHigh : Mirroring::OneScreen);
+}
+
+void AxROM::serialize(util::Serializer &s)
+{
+    Mapper::serialize(s);
+    s(reg, "axrom.reg");
+    if (s.loading())
+        update_banks();
+}
+
+void GxROM::serialize(util::Serializer &s)
+{
+    Mapper::serialize(s);
+    s(reg, "gxrom.reg");
+    if (s.loading())
+        update_banks();
+}
+
+
+
+MMC3::MMC3(System *s, std::span<u8> prg, std::span<u8> chr) : Mapper(s, prg, chr)
+{
+    resize_wram(8_KiB);
+    update_banks();
+}
+
+void MMC3::update_banks()
+{
+    // bit 6 swaps $8000 and $C000, bit 7 swaps the two CHR halves
+    unsigned prg_swap = bank_select >> 5 & 2;
+    unsigned chr_swap = bank_select >> 5 & 4;
+    prg8(0 ^ prg_swap, regs[6]);
+    prg8(1,            regs[7]);
+    prg8(2 ^ prg_swap, -2);
+    prg8(3,            -1);
+    chr2(0 ^ chr_swap / 2, regs[0] >> 1);
+    chr2(1 ^ chr_swap / 2, regs[1] >> 1);
+    chr1(4 ^ chr_swap,     regs[2]);
+    chr1(5 ^ chr_swap,     regs[3]);
+    chr1(6 ^ chr_swap,     regs[4]);
+    chr1(7 ^ chr_swap,     regs[5]);
+}
+
+void MMC3::write_rom(u16 addr, u8 data)
+{
+    switch (addr & 0xE001) {
+    case 0x8000: bank_select = data; break;
+    case 0x8001: regs[bank_select & 7] = data; break;
+    case 0xA000:
+        if (system->mirroring != Mirroring::FourScreen)
+            system->change_mirroring(data & 1 ? Mirroring::Horizontal : Mirroring::Vertical);
+        return;
+    // PRG RAM protection is ignored, as MMC6 games would break otherwise
+    case 0xA001: return;
+    case 0xC000: irq_latch = data;   return;
+    case 0xC001: irq_reload = true;  return;
+    case 0xE000:
+        irq_enabled = false;
+        system->cpu.set_irq(IRQSource::Mapper, false);
+        return;
+    case 0xE001: irq_enabled = true; return;
     }
+    update_banks();
+}
+
+void MMC3::a12_rise()
+{
+    if (irq_counter == 0 || irq_reload) {
+        irq_counter = irq_latch;
+        irq_reload = false;
+    } else
+        irq_counter--;
+    if (irq_counter == 0 && irq_enabled)
+        system->cpu.set_irq(IRQSource::Mapper, true);
+}
+
+void MMC3::serialize(util::Serializer &s)
+{
+    Mapper::serialize(s);
+    s(bank_select, "mmc3.bank_select");
+    s(regs,        "mmc3.regs");
+    s(irq_latch,   "mmc3.irq_latch");
+    s(irq_counter, "mmc3.irq_counter");
+    s(irq_reload,  "mmc3.irq_reload");
+    s(irq_enabled, "mmc3.irq_enabled");
+    if (s.loading())
+        update_banks();
 }
 
 } // namespace core
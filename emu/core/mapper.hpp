@@ -1,9 +1,24 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <span>
 #include <memory>
+#include <vector>
+#include <emu/util/arena.hpp>
 #include <emu/util/common.hpp>
 #include <emu/util/uint.hpp>
+#include <emu/util/serializer.hpp>
+
+/*
+ * Mappers. The base class keeps the address of the memory currently seen in
+ * each 8 KiB window of PRG ($8000-$FFFF) and each 1 KiB window of CHR
+ * ($0000-$1FFF), so that reading ROM is a single lookup. Mappers only need
+ * to recompute the windows (in update_banks()) when one of their registers
+ * is written, and after a state is loaded.
+ * Cartridges without CHR ROM get 8 KiB of CHR RAM.
+ * Mappers, their CHR RAM and their PRG RAM live in the system's arena.
+ */
 
 namespace core {
 
@@ -13,64 +28,146 @@ struct Mapper {
 protected:
     System *system;
     std::span<u8> prgrom, chrrom;
+    std::span<u8> chrram;
+    std::span<u8> wram;                 // either in the arena or a save file
+    std::span<u8> chr;                  // either chrrom or chrram
+    std::array<u8 *, 4> prg_window;
+    std::array<u8 *, 8> chr_window;
 
-public:
-    Mapper(System *s, std::span<u8> prg, std::span<u8> chr)
-        : system(s), prgrom(prg), chrrom(chr)
-    { }
+    // map a bank of n windows, starting from window first. banks are
+    // counted in units of the bank size; negative banks count from the end.
+    void map_prg(unsigned first, unsigned n, int bank);
+    void map_chr(unsigned first, unsigned n, int bank);
+    void prg8 (unsigned window, int bank) { map_prg(window, 1, bank); }
+    void prg16(unsigned window, int bank) { map_prg(window * 2, 2, bank); }
+    void prg32(int bank)                  { map_prg(0, 4, bank); }
+    void chr1 (unsigned window, int bank) { map_chr(window, 1, bank); }
+    void chr2 (unsigned window, int bank) { map_chr(window * 2, 2, bank); }
+    void chr4 (unsigned window, int bank) { map_chr(window * 4, 4, bank); }
+    void chr8 (int bank)                  { map_chr(0, 8, bank); }
 
+    virtual void update_banks() = 0;
+
+public:
+    Mapper(System *s, std::span<u8> prg, std::span<u8> chr);
     virtual ~Mapper() = default;
-    virtual u8 read_wram(u16 addr) = 0;
-    virtual u8 read_rom(u16 addr) = 0;
-    virtual u8 read_chr(u16 addr) = 0;
-    virtual void write_wram(u16 addr, u8 data) = 0;
+
+    // these are called for every memory access, so they're kept simple
+    u8 read_rom(u16 addr)              { return prg_window[addr >> 13 & 3][addr & 0x1FFF]; }
+    u8 read_chr(u16 addr)              { return chr_window[addr >> 10 & 7][addr & 0x3FF]; }
+    void write_chr(u16 addr, u8 data)  { if (!chrram.empty()) chr_window[addr >> 10 & 7][addr & 0x3FF] = data; }
+    u8 read_wram(u16 addr)             { return addr >= 0x6000 && !wram.empty() ? wram[addr & (wram.size() - 1)] : 0; }
+    void write_wram(u16 addr, u8 data) { if (addr >= 0x6000 && !wram.empty()) wram[addr & (wram.size() - 1)] = data; }
+
+    // PRG RAM at $6000-$7FFF. sizes are powers of two. battery-backed RAM
+    // lives in a memory-mapped save file, so that writing to it is still
+    // just a store.
+    std::size_t wram_size() const       { return wram.size(); }
+    void resize_wram(std::size_t size);
+    void set_wram(std::span<u8> mem)    { wram = mem; }
+
     virtual void write_rom(u16 addr, u8 data) = 0;
-    virtual void write_chr(u16 addr, u8 data) = 0;
+    virtual void serialize(util::Serializer &s);
+    void power() { update_banks(); }
 
-    static std::unique_ptr<Mapper> create(unsigned number, System *s);
+    // mappers that count scanlines do it by watching for rising edges on
+    // the PPU address line A12. the PPU only reports them to those who ask.
+    virtual bool watches_a12() const { return false; }
+    virtual void a12_rise() { }
+
+    static util::ArenaPtr<Mapper> create(unsigned number, System *s);
 };
 
 struct NROM : public Mapper {
-    using Mapper::Mapper;
-    u8 read_wram(u16 addr)             { return 0; }
-    u8 read_rom(u16 addr)              { return prgrom[addr & (prgrom.size() - 1)]; }
-    u8 read_chr(u16 addr)              { return chrrom[addr         ]; }
-    void write_wram(u16 addr, u8 data) { }
-    void write_rom(u16 addr, u8 data)  { }
-    void write_chr(u16 addr, u8 data)  { }
+    NROM(System *s, std::span<u8> prg, std::span<u8> chr) : Mapper(s, prg, chr) { update_banks(); }
+    void update_banks() override       { prg32(0); chr8(0); }
+    void write_rom(u16 addr, u8 data) override { }
 };
 
 class MMC1 : public Mapper {
     int counter  = 0;
     u5 shift     = 0;
+    u5 control   = 0x0C;
+    u5 chr_bank[2] = { 0, 0 };
+    u5 prg_bank  = 0;
+
+    void update_banks() override;
+
+public:
+    MMC1(System *s, std::span<u8> prg, std::span<u8> chr);
+    void write_rom(u16 addr, u8 data) override;
+    void serialize(util::Serializer &s) override;
+};
+
+// UxROM: 16 KiB switchable PRG bank, last bank fixed.
+class UxROM : public Mapper {
+    u8 bank = 0;
+    void update_banks() override       { prg16(0, bank); prg16(1, -1); chr8(0); }
+
+public:
+    UxROM(System *s, std::span<u8> prg, std::span<u8> chr) : Mapper(s, prg, chr) { update_banks(); }
+    void write_rom(u16 addr, u8 data) override { bank = data; update_banks(); }
+    void serialize(util::Serializer &s) override;
+};
+
+// CNROM: 8 KiB switchable CHR bank.
+class CNROM : public Mapper {
+    u8 bank = 0;
+    void update_banks() override       { prg32(0); chr8(bank); }
+
+public:
+    CNROM(System *s, std::span<u8> prg, std::span<u8> chr) : Mapper(s, prg, chr) { update_banks(); }
+    void write_rom(u16 addr, u8 data) override { bank = data; update_banks(); }
+    void serialize(util::Serializer &s) override;
+};
+
+// AxROM: 32 KiB switchable PRG bank, one-screen mirroring selectable.
+class AxROM : public Mapper {
+    u8 reg = 0;
+    void update_banks() override;
 
-    struct {
-        u2 mode  = 3;
-        // bank[0] always contains the value of the first bank
-        // bank[3] always contains the value of the last bank
-        // bank[1] and [2] act as if they're the same; they're mapper settable
-        u5 bank[4] = { 0, 0, 0, 0 };
-    } prg;
+public:
+    // the mirroring is set at power, once the system is ready for it
+    AxROM(System *s, std::span<u8> prg, std::span<u8> chr) : Mapper(s, prg, chr) { prg32(0); chr8(0); }
+    void write_rom(u16 addr, u8 data) override { reg = data; update_banks(); }
+    void serialize(util::Serializer &s) override;
+};
 
-    struct {
-        u1 mode = 0;
-        u5 bank[2] = { 0, 0 };
-    } chr;
+// GxROM: 32 KiB switchable PRG bank and 8 KiB switchable CHR bank.
+class GxROM : public Mapper {
+    u8 reg = 0;
+    void update_banks() override       { prg32(reg >> 4 & 3); chr8(reg & 3); }
 
-    u8 read(std::span<u8> rom, u16 addr, u5 *bank, u1 mode, u8 magic_start);
+public:
+    GxROM(System *s, std::span<u8> prg, std::span<u8> chr) : Mapper(s, prg, chr) { update_banks(); }
+    void write_rom(u16 addr, u8 data) override { reg = data; update_banks(); }
+    void serialize(util::Serializer &s) override;
+};
+
+// MMC3: 8 KiB PRG banks, 1/2 KiB CHR banks, 8 KiB PRG RAM and a scanline
+// counter clocked by A12.
+class MMC3 : public Mapper {
+    u8 bank_select = 0;
+    // power-on values are undefined; these look like NROM
+    std::array<u8, 8> regs = { 0, 2, 4, 5, 6, 7, 0, 1 };
+    u8 irq_latch    = 0;
+    u8 irq_counter  = 0;
+    bool irq_reload  = false;
+    bool irq_enabled = false;
+
+    void update_banks() override;
 
 public:
-    MMC1(System *s, std::span<u8> prgrom, std::span<u8> chr) : Mapper(s, prgrom, chr)
-    {
-        prg.bank[3] = prgrom.size() / (0x4000) - 1;
-    }
-
-    u8 read_wram(u16 addr) { return 0; }
-    u8 read_rom(u16 addr);
-    u8 read_chr(u16 addr);
-    void write_wram(u16 addr, u8 data) { }
-    void write_rom(u16 addr, u8 data);
-    void write_chr(u16 addr, u8 data)  { }
+    MMC3(System *s, std::span<u8> prg, std::span<u8> chr);
+    void write_rom(u16 addr, u8 data) override;
+    void serialize(util::Serializer &s) override;
+    bool watches_a12() const override { return true; }
+    void a12_rise() override;
 };
 
+// the arena needs room for the biggest of them
+inline constexpr std::size_t MAPPER_MAX_SIZE = std::max({
+    sizeof(NROM), sizeof(MMC1), sizeof(UxROM), sizeof(CNROM), sizeof(AxROM), sizeof(GxROM), sizeof(MMC3),
+});
+
 } // namespace core
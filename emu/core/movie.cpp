@@ -0,0 +1,134 @@
+#include "movie.hpp"
+
+#include <array>
+#include <cstring>
+#include <emu/util/crc32.hpp>
+#include <emu/util/debug.hpp>
+
+using input::Button;
+
+namespace core {
+
+namespace {
+
+constexpr char MAGIC[] = "YNMV";
+// flush the recording every this many bytes
+constexpr std::size_t BUFFER_SIZE = 64 * 1024;
+
+constexpr Button button_order[] = {
+    Button::A,  Button::B,    Button::Select, Button::Start,
+    Button::Up, Button::Down, Button::Left,   Button::Right,
+};
+
+u32 read_u32(const u8 *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | u32(p[3]) << 24;
+}
+
+void write_u32(u8 *p, u32 x)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = x >> (i * 8);
+}
+
+} // namespace
+
+u8 keys_to_mask(input::Keys keys)
+{
+    u8 mask = 0;
+    for (int i = 0; i < 8; i++)
+        mask |= u8(keys[button_order[i]]) << i;
+    return mask;
+}
+
+input::Keys mask_to_keys(u8 mask)
+{
+    input::Keys keys;
+    for (int i = 0; i < 8; i++)
+        keys[button_order[i]] = mask >> i & 1;
+    return keys;
+}
+
+bool Movie::play(std::string_view path)
+{
+    stop();
+    auto file = io::MappedFile::open(path);
+    if (!file || file.value().size() < HEADER_SIZE)
+        return false;
+    const u8 *header = file.value().data();
+    if (std::memcmp(header, MAGIC, 4) != 0 || header[4] != VERSION)
+        return false;
+    if ((file.value().size() - HEADER_SIZE) % RECORD_SIZE != 0)
+        warning("movie {} has a truncated frame at the end\n", path);
+    crc   = read_u32(header + 8);
+    in    = std::move(file);
+    frame = 0;
+    mode  = Mode::Playing;
+    return true;
+}
+
+bool Movie::record(std::string_view path, u32 rom_crc)
+{
+    stop();
+    auto file = io::File::open(path, io::Access::Write);
+    if (!file)
+        return false;
+    out = std::move(file);
+    std::array<u8, HEADER_SIZE> header = {};
+    std::memcpy(header.data(), MAGIC, 4);
+    header[4] = VERSION;
+    write_u32(header.data() + 8, rom_crc);
+    outbuf.clear();
+    outbuf.reserve(BUFFER_SIZE);
+    outbuf.insert(outbuf.end(), header.begin(), header.end());
+    crc   = rom_crc;
+    frame = 0;
+    mode  = Mode::Recording;
+    return true;
+}
+
+void Movie::flush()
+{
+    if (!out || outbuf.empty())
+        return;
+    std::fwrite(outbuf.data(), 1, outbuf.size(), out.value().data());
+    std::fflush(out.value().data());
+    outbuf.clear();
+}
+
+void Movie::stop()
+{
+    flush();
+    in.reset();
+    out.reset();
+    mode = Mode::None;
+}
+
+std::optional<Movie::Frame> Movie::next()
+{
+    if (!playing() || finished())
+        return std::nullopt;
+    const u8 *p = in.value().data() + HEADER_SIZE + frame * RECORD_SIZE;
+    frame++;
+    return Frame { .keys = mask_to_keys(p[0]), .events = p[1] };
+}
+
+u32 Movie::input_crc(std::size_t frames) const
+{
+    if (!playing())
+        return 0;
+    return util::crc32({ in.value().data() + HEADER_SIZE, std::min(frames, length()) * RECORD_SIZE });
+}
+
+void Movie::write(Frame f)
+{
+    if (!recording())
+        return;
+    outbuf.push_back(keys_to_mask(f.keys));
+    outbuf.push_back(f.events);
+    frame++;
+    if (outbuf.size() >= BUFFER_SIZE)
+        flush();
+}
+
+} // namespace core
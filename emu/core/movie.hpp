@@ -0,0 +1,87 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+#include <vector>
+#include <emu/backend/input.hpp>
+#include <emu/util/io.hpp>
+#include <emu/util/uint.hpp>
+
+/*
+ * Input movies. A movie file is made of a 16 byte header:
+ *     0-3   "YNMV"
+ *     4     version
+ *     5-7   unused
+ *     8-11  CRC32 of the PRG and CHR ROM (little endian)
+ *     12-15 unused
+ * followed by one 2 byte record for each frame:
+ *     0     buttons held on controller 1, one bit each, in the order
+ *           they're read by the CPU (A, B, Select, Start, Up, Down, Left, Right)
+ *     1     events happening before the frame (bit 0: reset, bit 1: power)
+ * The number of frames is given by the file size, so an interrupted
+ * recording is still a valid movie.
+ * Movies are played back from a memory mapped file and recorded through a
+ * write buffer.
+ */
+
+namespace core {
+
+class Movie {
+public:
+    static constexpr int HEADER_SIZE = 16;
+    static constexpr int RECORD_SIZE = 2;
+    static constexpr u8 VERSION = 1;
+
+    enum Event : u8 {
+        None  = 0,
+        Reset = 1 << 0,
+        Power = 1 << 1,
+    };
+
+    struct Frame {
+        input::Keys keys;
+        u8 events = Event::None;
+    };
+
+private:
+    enum class Mode { None, Playing, Recording } mode = Mode::None;
+    std::optional<io::MappedFile> in;
+    std::optional<io::File> out;
+    std::vector<u8> outbuf;
+    std::size_t frame = 0;
+    u32 crc = 0;
+
+    void flush();
+
+public:
+    Movie() = default;
+    ~Movie() { stop(); }
+    Movie(const Movie &) = delete;
+    Movie & operator=(const Movie &) = delete;
+
+    bool play(std::string_view path);
+    bool record(std::string_view path, u32 rom_crc);
+    void stop();
+
+    std::optional<Frame> next();
+    void write(Frame f);
+    // skips playback forward (or back) to a frame
+    void seek(std::size_t f)        { frame = std::min(f, length()); }
+    // CRC32 of the records of the first frames being played
+    u32 input_crc(std::size_t frames) const;
+
+    bool playing() const    { return mode == Mode::Playing; }
+    bool recording() const  { return mode == Mode::Recording; }
+    bool finished() const   { return playing() && frame >= length(); }
+    std::size_t position() const { return frame; }
+    std::size_t length() const
+    {
+        return in ? (in.value().size() - HEADER_SIZE) / RECORD_SIZE : frame;
+    }
+    u32 rom_crc() const     { return crc; }
+};
+
+u8 keys_to_mask(input::Keys keys);
+input::Keys mask_to_keys(u8 mask);
+
+} // namespace core
@@ -0,0 +1,234 @@
+#include "netplay.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <emu/core/emulator.hpp>
+#include <emu/core/movie.hpp>
+
+namespace core {
+
+namespace {
+
+/*
+ * Packet format (little endian):
+ *     0-3   frame of the first input
+ *     4-7   last frame we have the sender's input for (+1, so that 0 means none)
+ *     8     number of inputs
+ *     9-    one button mask per frame
+ */
+constexpr std::size_t PACKET_HEADER_SIZE = 9;
+
+// the one used by the NTSC NES
+constexpr auto FRAME_TIME = std::chrono::nanoseconds(16'639'267);
+
+void put_u32(std::vector<u8> &out, u32 x)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back(x >> (i * 8));
+}
+
+u32 get_u32(const u8 *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | u32(p[3]) << 24;
+}
+
+} // namespace
+
+Netplay::Netplay(Emulator &e, io::UdpSocket &&s, Config config)
+    : emu(&e), sock(std::move(s)), conf(config)
+{
+    for (auto &state : states)
+        state.resize(emu->state_size());
+}
+
+u8 Netplay::predict(long frame) const
+{
+    if (frame <= remote_confirmed)
+        return remote_input[frame % RING_SIZE];
+    return remote_confirmed >= 0 ? remote_input[remote_confirmed % RING_SIZE] : 0;
+}
+
+void Netplay::simulate(long frame, bool output)
+{
+    u8 local  = local_input[frame % RING_SIZE];
+    u8 remote = predict(frame);
+    remote_used[frame % RING_SIZE] = remote;
+    auto p1 = mask_to_keys(conf.player == 1 ? local : remote);
+    auto p2 = mask_to_keys(conf.player == 1 ? remote : local);
+    emu->run_frame(p1, p2, output);
+}
+
+void Netplay::rollback()
+{
+    if (rollback_to < 0)
+        return;
+    auto start = Clock::now();
+    emu->load_state(states[rollback_to % states.size()]);
+    for (long f = rollback_to; f < curr_frame; f++) {
+        if (f != rollback_to)
+            emu->save_state(states[f % states.size()]);
+        simulate(f, false);
+    }
+    st.rollbacks++;
+    st.resim_frames += curr_frame - rollback_to;
+    st.resim_time   += std::chrono::duration<double>(Clock::now() - start).count();
+    rollback_to = -1;
+}
+
+bool Netplay::run_frame(input::Keys local)
+{
+    poll();
+    if (curr_frame - remote_confirmed > MAX_ROLLBACK) {
+        if (!stalled)
+            st.stalls++;
+        stalled = true;
+        return false;
+    }
+    stalled = false;
+    local_input[curr_frame % RING_SIZE] = keys_to_mask(local);
+    emu->save_state(states[curr_frame % states.size()]);
+    simulate(curr_frame, conf.show_video);
+    curr_frame++;
+    st.frames++;
+    send_inputs();
+    return true;
+}
+
+void Netplay::poll()
+{
+    receive();
+    rollback();
+    flush_outgoing();
+    // keep the peer updated even when we aren't running frames
+    if (Clock::now() - last_send >= FRAME_TIME / 4)
+        send_inputs();
+}
+
+void Netplay::send_inputs()
+{
+    long first = std::max(peer_ack + 1, curr_frame - MAX_PACKET_INPUTS);
+    long count = curr_frame - first;
+    std::vector<u8> packet;
+    packet.reserve(PACKET_HEADER_SIZE + count);
+    put_u32(packet, first);
+    put_u32(packet, remote_confirmed + 1);
+    packet.push_back(count);
+    for (long f = first; f < curr_frame; f++)
+        packet.push_back(local_input[f % RING_SIZE]);
+    last_send = Clock::now();
+    st.packets_sent++;
+    if (conf.sim_loss_percent != 0 && rng() % 100 < conf.sim_loss_percent) {
+        st.packets_dropped++;
+        return;
+    }
+    outgoing.push_back({ .when = last_send + std::chrono::milliseconds(conf.sim_latency_ms),
+                         .data = std::move(packet) });
+    flush_outgoing();
+}
+
+void Netplay::flush_outgoing()
+{
+    auto now = Clock::now();
+    while (!outgoing.empty() && outgoing.front().when <= now) {
+        sock.send(conf.peer, outgoing.front().data);
+        outgoing.pop_front();
+    }
+}
+
+void Netplay::receive()
+{
+    std::array<u8, PACKET_HEADER_SIZE + MAX_PACKET_INPUTS> buf;
+    while (auto size = sock.recv(buf)) {
+        if (size.value() < PACKET_HEADER_SIZE)
+            continue;
+        st.packets_received++;
+        long first = get_u32(&buf[0]);
+        long ack   = long(get_u32(&buf[4])) - 1;
+        long count = std::min<long>(buf[8], size.value() - PACKET_HEADER_SIZE);
+        peer_ack = std::max(peer_ack, ack);
+        // only take inputs right after the ones we have; since every packet
+        // carries all unacknowledged inputs, anything skipped will come again.
+        for (long f = std::max(first, remote_confirmed + 1); f < first + count && f == remote_confirmed + 1; f++) {
+            u8 keys = buf[PACKET_HEADER_SIZE + f - first];
+            remote_input[f % RING_SIZE] = keys;
+            remote_confirmed = f;
+            if (f < curr_frame && remote_used[f % RING_SIZE] != keys && (rollback_to < 0 || f < rollback_to))
+                rollback_to = f;
+        }
+    }
+}
+
+std::optional<LoopbackResult> netplay_loopback_test(const Cartridge::Data &cart, unsigned latency_ms,
+                                                    unsigned loss_percent, unsigned frames)
+{
+    std::unique_ptr<Emulator> emus[2];
+    std::optional<io::UdpSocket> socks[2];
+    std::optional<io::Address> addrs[2];
+    for (int i = 0; i < 2; i++) {
+        emus[i] = std::make_unique<Emulator>();
+        if (!emus[i]->insert_rom(cart))
+            return std::nullopt;
+        emus[i]->power();
+        socks[i] = io::UdpSocket::open(0);
+        if (!socks[i])
+            return std::nullopt;
+        addrs[i] = io::Address::resolve("127.0.0.1", socks[i].value().local_port().value_or(0));
+        if (!addrs[i])
+            return std::nullopt;
+    }
+
+    LoopbackResult result;
+    std::atomic<int> done = 0;
+    std::vector<u8> final_states[2];
+    const auto player = [&](int i) {
+        Netplay netplay{*emus[i], std::move(socks[i].value()), {
+            .player           = unsigned(i + 1),
+            .peer             = addrs[1 - i].value(),
+            .show_video       = false,
+            .sim_latency_ms   = latency_ms,
+            .sim_loss_percent = loss_percent,
+        }};
+        // buttons are held for a random amount of frames, like a person would
+        std::minstd_rand rng(i + 1);
+        u8 keys = 0;
+        long change_at = 0;
+        auto next = std::chrono::steady_clock::now();
+        while (netplay.frame() < long(frames)) {
+            if (netplay.frame() >= change_at) {
+                keys = rng();
+                change_at = netplay.frame() + 1 + rng() % 30;
+            }
+            if (netplay.run_frame(mask_to_keys(keys))) {
+                next += FRAME_TIME;
+                std::this_thread::sleep_until(next);
+            } else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        // wait until both sides have every input, then keep answering
+        // until the other side is done too
+        bool counted = false;
+        auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (done < 2 && std::chrono::steady_clock::now() < timeout) {
+            netplay.poll();
+            if (!counted && netplay.confirmed(frames - 1)) {
+                counted = true;
+                done++;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        result.stats[i] = netplay.stats();
+        final_states[i].resize(emus[i]->state_size());
+        emus[i]->save_state(final_states[i]);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread t1{player, 0}, t2{player, 1};
+    t1.join();
+    t2.join();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.states_match = done == 2 && final_states[0] == final_states[1];
+    return result;
+}
+
+} // namespace core
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <random>
+#include <vector>
+#include <emu/core/cartridge.hpp>
+#include <emu/backend/input.hpp>
+#include <emu/util/common.hpp>
+#include <emu/util/socket.hpp>
+
+/*
+ * Rollback netplay for two players over UDP.
+ * Each side runs frames right away using its local input and a prediction
+ * of the remote one (the remote player is assumed to keep holding the same
+ * buttons). The state at the start of each frame is saved. When the real
+ * remote input for a frame arrives and differs from the prediction, we load
+ * the state of that frame and run again up to the present frame, without
+ * showing anything. We never run more than MAX_ROLLBACK frames ahead of the
+ * last confirmed remote input.
+ * Each packet carries all the local inputs the peer hasn't acknowledged yet,
+ * so lost packets are never resent: the next one covers them.
+ * Latency and packet loss can be simulated on outgoing packets for testing.
+ */
+
+namespace core {
+
+class Emulator;
+
+class Netplay {
+public:
+    static constexpr long MAX_ROLLBACK = 8;
+
+    struct Config {
+        unsigned player = 1;                    // 1 or 2
+        io::Address peer;
+        bool show_video = true;
+        unsigned sim_latency_ms = 0;            // added to every outgoing packet
+        unsigned sim_loss_percent = 0;          // chance of dropping an outgoing packet
+    };
+
+    struct Stats {
+        unsigned long frames = 0;
+        unsigned long rollbacks = 0;
+        unsigned long resim_frames = 0;
+        double resim_time = 0;                  // seconds
+        unsigned long stalls = 0;
+        unsigned long packets_sent = 0;
+        unsigned long packets_dropped = 0;
+        unsigned long packets_received = 0;
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // must be bigger than the inputs a single packet can carry
+    static constexpr long RING_SIZE = 64;
+    static constexpr long MAX_PACKET_INPUTS = 32;
+
+    struct Delayed {
+        Clock::time_point when;
+        std::vector<u8> data;
+    };
+
+    Emulator *emu;
+    io::UdpSocket sock;
+    Config conf;
+    Stats st;
+
+    std::array<u8, RING_SIZE> local_input  = {};
+    std::array<u8, RING_SIZE> remote_input = {};
+    std::array<u8, RING_SIZE> remote_used  = {};
+    std::array<std::vector<u8>, MAX_ROLLBACK + 1> states;
+
+    long curr_frame       = 0;      // next frame to run
+    long remote_confirmed = -1;     // last frame we have the remote input for
+    long peer_ack         = -1;     // last frame the peer has our input for
+    long rollback_to      = -1;
+    bool stalled          = false;
+
+    std::deque<Delayed> outgoing;
+    std::minstd_rand rng{1};
+    Clock::time_point last_send;
+
+    u8 predict(long frame) const;
+    void simulate(long frame, bool output);
+    void rollback();
+    void send_inputs();
+    void flush_outgoing();
+    void receive();
+
+public:
+    Netplay(Emulator &e, io::UdpSocket &&s, Config config);
+
+    // runs the next frame with the given local input. returns false if
+    // we're too far ahead of the peer and must wait for its input.
+    bool run_frame(input::Keys local);
+    // handles network traffic and rollbacks, without advancing.
+    void poll();
+
+    long frame() const                  { return curr_frame; }
+    // true when both sides have all inputs up to the given frame.
+    bool confirmed(long frame) const    { return remote_confirmed >= frame && peer_ack >= frame; }
+    const Stats & stats() const         { return st; }
+};
+
+struct LoopbackResult {
+    Netplay::Stats stats[2];
+    double seconds;
+    bool states_match;
+};
+
+// runs two netplay sessions against each other on 127.0.0.1, with
+// simulated latency and packet loss, and random input on both sides.
+std::optional<LoopbackResult> netplay_loopback_test(const Cartridge::Data &cart, unsigned latency_ms,
+                                                    unsigned loss_percent, unsigned frames);
+
+} // namespace core
@@ -0,0 +1,284 @@
+#include "patch.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <fmt/core.h>
+#include <unistd.h>
+#include <emu/util/crc32.hpp>
+
+namespace core {
+
+namespace {
+
+// the ROM being patched. writes that don't change anything are skipped,
+// so that the page isn't copied.
+class Target {
+    std::span<u8> mem;
+    std::size_t page_size;
+    std::vector<bool> dirty;
+    std::size_t pages = 0;
+
+public:
+    Target(std::span<u8> m, std::size_t page)
+        : mem(m), page_size(page), dirty((m.size() + page - 1) / page)
+    { }
+
+    std::size_t size() const       { return mem.size(); }
+    std::size_t pages_copied() const { return pages; }
+    u8 get(std::size_t addr) const  { return mem[addr]; }
+
+    void put(std::size_t addr, u8 data)
+    {
+        if (mem[addr] == data)
+            return;
+        mem[addr] = data;
+        if (!dirty[addr / page_size]) {
+            dirty[addr / page_size] = true;
+            pages++;
+        }
+    }
+};
+
+u32 read_be(const u8 *p, int bytes)
+{
+    u32 x = 0;
+    for (int i = 0; i < bytes; i++)
+        x = x << 8 | p[i];
+    return x;
+}
+
+u32 read_le(const u8 *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | u32(p[3]) << 24;
+}
+
+/*
+ * IPS: "PATCH", then records made of a 3 byte offset and a 2 byte size
+ * (big endian) followed by size bytes of data. a size of 0 means a run:
+ * 2 bytes of length and the byte to repeat. the records end with "EOF",
+ * which may be followed by a 3 byte size to truncate the file to.
+ */
+struct IPSRecord {
+    u32 offset;
+    u32 size;
+    const u8 *data;     // nullptr for runs
+    u8 fill;
+};
+
+// calls fn for each record, then returns the size of the patched file.
+// returns nullopt if the patch is broken.
+std::optional<std::size_t> read_ips(std::span<const u8> patch, std::size_t source_size, auto &&fn)
+{
+    std::size_t pos = 5;
+    std::size_t size = source_size;
+    const auto left = [&] { return patch.size() - pos; };
+    while (left() >= 3) {
+        u32 offset = read_be(&patch[pos], 3);
+        pos += 3;
+        if (offset == 0x454F46) {
+            if (left() >= 3)
+                size = read_be(&patch[pos], 3);
+            return size;
+        }
+        if (left() < 2)
+            return std::nullopt;
+        IPSRecord rec = { .offset = offset, .size = read_be(&patch[pos], 2), .data = nullptr, .fill = 0 };
+        pos += 2;
+        if (rec.size == 0) {
+            if (left() < 3)
+                return std::nullopt;
+            rec.size = read_be(&patch[pos], 2);
+            rec.fill = patch[pos + 2];
+            pos += 3;
+        } else {
+            if (left() < rec.size)
+                return std::nullopt;
+            rec.data = &patch[pos];
+            pos += rec.size;
+        }
+        size = std::max<std::size_t>(size, rec.offset + rec.size);
+        fn(rec);
+    }
+    return std::nullopt;
+}
+
+bool apply_ips(std::span<const u8> patch, std::string_view rompath, std::size_t source_size,
+               std::optional<io::MappedFile> &out, PatchInfo &info)
+{
+    auto size = read_ips(patch, source_size, [](const IPSRecord &) { });
+    if (!size) {
+        info.error = "broken IPS patch";
+        return false;
+    }
+    out = io::MappedFile::open_private(rompath, size.value());
+    if (!out) {
+        info.error = fmt::format("couldn't map {}", rompath);
+        return false;
+    }
+    Target target{{ out.value().data(), out.value().size() }, info.page_size};
+    read_ips(patch, source_size, [&](const IPSRecord &rec) {
+        // records past a truncation point have nowhere to go
+        for (u32 i = 0; i < rec.size && rec.offset + i < target.size(); i++)
+            target.put(rec.offset + i, rec.data ? rec.data[i] : rec.fill);
+        info.records++;
+    });
+    info.pages = target.pages_copied();
+    return true;
+}
+
+/*
+ * BPS: "BPS1", the source, target and metadata sizes as variable length
+ * numbers, the metadata, then actions until the last 12 bytes, which hold
+ * the CRC32 of the source, of the target and of the patch up to there.
+ * each action copies length bytes to the target, from the same offset of
+ * the source (SourceRead), from the patch (TargetRead), or from a moving
+ * position in the source or in the target itself (SourceCopy, TargetCopy).
+ */
+class BPSReader {
+    std::span<const u8> patch;
+    std::size_t pos = 4;
+
+public:
+    explicit BPSReader(std::span<const u8> p) : patch(p) { }
+
+    std::size_t left() const { return patch.size() - 12 - pos; }
+    bool done() const        { return pos >= patch.size() - 12; }
+    u8 byte()                { return done() ? 0 : patch[pos++]; }
+    void skip(std::size_t n) { pos += std::min(n, left()); }
+
+    u64 number()
+    {
+        u64 data = 0, shift = 1;
+        for (int i = 0; i < 10; i++) {
+            u8 x = byte();
+            data += (x & 0x7F) * shift;
+            if (x & 0x80)
+                break;
+            shift <<= 7;
+            data += shift;
+        }
+        return data;
+    }
+
+    i64 offset()
+    {
+        u64 n = number();
+        return (n & 1 ? -1 : 1) * i64(n >> 1);
+    }
+};
+
+bool apply_bps(std::span<const u8> patch, std::string_view rompath, std::span<const u8> source,
+               std::optional<io::MappedFile> &out, PatchInfo &info)
+{
+    if (patch.size() < 4 + 3 + 12) {
+        info.error = "broken BPS patch";
+        return false;
+    }
+    const u8 *footer = &patch[patch.size() - 12];
+    if (util::crc32(patch.subspan(0, patch.size() - 4)) != read_le(footer + 8)) {
+        info.error = "BPS patch is corrupted (wrong checksum)";
+        return false;
+    }
+    BPSReader reader{patch};
+    u64 source_size = reader.number();
+    u64 target_size = reader.number();
+    reader.skip(reader.number());
+    if (source_size != source.size() || util::crc32(source) != read_le(footer)) {
+        info.error = "BPS patch is for a different ROM";
+        return false;
+    }
+
+    out = io::MappedFile::open_private(rompath, target_size);
+    if (!out) {
+        info.error = fmt::format("couldn't map {}", rompath);
+        return false;
+    }
+    // the target starts as a copy of the source, so reading from the
+    // source at the same offset (by far the most common action) costs
+    // nothing. copies from the source read the file's own read-only
+    // mapping, which patching doesn't change.
+    Target target{{ out.value().data(), out.value().size() }, info.page_size};
+    std::size_t outpos = 0;
+    i64 source_rel = 0, target_rel = 0;
+    while (!reader.done()) {
+        u64 data = reader.number();
+        u64 length = (data >> 2) + 1;
+        if (length > target.size() - outpos) {
+            info.error = "BPS patch writes past the end of the ROM";
+            return false;
+        }
+        switch (data & 3) {
+        case 0:
+            for (u64 i = 0; i < length; i++, outpos++)
+                target.put(outpos, outpos < source.size() ? source[outpos] : 0);
+            break;
+        case 1:
+            if (length > reader.left()) {
+                info.error = "broken BPS patch";
+                return false;
+            }
+            for (u64 i = 0; i < length; i++)
+                target.put(outpos++, reader.byte());
+            break;
+        case 2:
+            source_rel += reader.offset();
+            if (source_rel < 0 || u64(source_rel) + length > source.size()) {
+                info.error = "broken BPS patch";
+                return false;
+            }
+            for (u64 i = 0; i < length; i++)
+                target.put(outpos++, source[source_rel++]);
+            break;
+        case 3:
+            target_rel += reader.offset();
+            if (target_rel < 0 || u64(target_rel) >= outpos) {
+                info.error = "broken BPS patch";
+                return false;
+            }
+            // may overlap what's being written: that's how runs are made
+            for (u64 i = 0; i < length; i++)
+                target.put(outpos++, target.get(target_rel++));
+            break;
+        }
+        info.records++;
+    }
+    info.pages = target.pages_copied();
+    if (outpos != target.size() || util::crc32({ out.value().data(), out.value().size() }) != read_le(footer + 4)) {
+        info.error = "BPS patch gave the wrong result";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::optional<io::MappedFile> patch_rom(std::string_view rompath, std::string_view patchpath, PatchInfo &info)
+{
+    auto start = std::chrono::steady_clock::now();
+    info.page_size = ::sysconf(_SC_PAGESIZE);
+    auto patch  = io::MappedFile::open(patchpath);
+    auto source = io::MappedFile::open(rompath);
+    if (!patch || !source) {
+        info.error = fmt::format("couldn't open {}", !patch ? patchpath : rompath);
+        return std::nullopt;
+    }
+    std::span<const u8> p = { patch.value().data(), patch.value().size() };
+    std::optional<io::MappedFile> out;
+    bool ok = false;
+    if (p.size() >= 5 && std::memcmp(p.data(), "PATCH", 5) == 0) {
+        info.format = "IPS";
+        ok = apply_ips(p, rompath, source.value().size(), out, info);
+    } else if (p.size() >= 4 && std::memcmp(p.data(), "BPS1", 4) == 0) {
+        info.format = "BPS";
+        ok = apply_bps(p, rompath, { source.value().data(), source.value().size() }, out, info);
+    } else
+        info.error = "not an IPS or BPS patch";
+    info.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok)
+        return std::nullopt;
+    info.size = out.value().size();
+    return out;
+}
+
+} // namespace core
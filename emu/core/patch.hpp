@@ -0,0 +1,33 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <emu/util/io.hpp>
+
+/*
+ * Soft-patching. IPS and BPS patches (told apart by their magic) are
+ * applied when a ROM is loaded, so that patched copies don't need to be
+ * stored. The ROM is mapped privately for writing, and bytes are only
+ * written when the patch changes them: the pages a patch doesn't touch
+ * stay shared with the page cache (and with any other mapping of the
+ * file).
+ * BPS patches are checked against the CRC32 of the source, of the target
+ * and of the patch itself. IPS has no checksums.
+ */
+
+namespace core {
+
+struct PatchInfo {
+    std::string error;          // why patching failed
+    const char *format = "";
+    std::size_t records = 0;    // IPS records or BPS actions
+    std::size_t size = 0;       // size of the patched ROM
+    std::size_t pages = 0;      // pages copied, because they were written to
+    std::size_t page_size = 0;
+    double seconds = 0;
+};
+
+std::optional<io::MappedFile> patch_rom(std::string_view rompath, std::string_view patchpath, PatchInfo &info);
+
+} // namespace core
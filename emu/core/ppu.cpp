@@ -5,6 +5,7 @@
 #include <functional>
 #include <fmt/core.h>
 #include <emu/core/bus.hpp>
+#include <emu/core/mapper.hpp>
 #include <emu/util/easyrandom.hpp>
 #include <emu/util/debug.hpp>
 
@@ -85,13 +86,65 @@ void PPU::power(bool reset)
     io.scroll_latch = 0;
     // PPUData
     io.data_buf = 0;
+    io.latch = 0;
     // other
     odd_frame = 0;
     lines = cycles = 0;
     vram.addr = 0;
     vram.tmp = 0;
+    vram.buf = 0;
+    // internal rendering state, so that powering on always
+    // gives the same results
+    tile   = {};
+    shift  = {};
+    sprite = {};
+    oam.data = 0;
+    oam.sp_counter = 0;
+    oam.inrange = oam.read_ff = oam.addr_overflow = 0;
+    oam.sp0_next = oam.sp0_curr = 0;
+    std::fill(std::begin(oam.pt_low),  std::end(oam.pt_low),  0);
+    std::fill(std::begin(oam.pt_high), std::end(oam.pt_high), 0);
+    std::fill(std::begin(oam.attrs),   std::end(oam.attrs),   0);
+    std::fill(std::begin(oam.xpos),    std::end(oam.xpos),    0);
     std::fill(oam.mem.begin(), oam.mem.end(), 0);
+    secondary_oam.index = 0;
     std::fill(secondary_oam.mem.begin(), secondary_oam.mem.end(), 0);
+    a12.last_high = 0;
+    a12.vaddr_high = false;
+    a12_update();
+}
+
+void PPU::serialize(util::Serializer &s)
+{
+    s(cycles,             "ppu.cycles");
+    s(lines,              "ppu.lines");
+    s(odd_frame,          "ppu.odd_frame");
+    s(io,                 "ppu.io");
+    s(vram.addr.v,        "ppu.v");
+    s(vram.tmp.v,         "ppu.t");
+    s(vram.fine_x,        "ppu.fine_x");
+    s(vram.buf,           "ppu.vram_buf");
+    s(tile,               "ppu.tile");
+    s(shift,              "ppu.shift");
+    s(oam.addr,           "ppu.oam_addr");
+    s(oam.data,           "ppu.oam_data");
+    s(oam.sp_counter,     "ppu.oam_sp_counter");
+    s(oam.inrange,        "ppu.oam_inrange");
+    s(oam.read_ff,        "ppu.oam_read_ff");
+    s(oam.addr_overflow,  "ppu.oam_addr_overflow");
+    s(oam.sp0_next,       "ppu.sp0_next");
+    s(oam.sp0_curr,       "ppu.sp0_curr");
+    s(oam.pt_low,         "ppu.sprite_pt_low");
+    s(oam.pt_high,        "ppu.sprite_pt_high");
+    s(oam.attrs,          "ppu.sprite_attrs");
+    s(oam.xpos,           "ppu.sprite_xpos");
+    s(oam.mem,            "oam");
+    s(secondary_oam,      "ppu.secondary_oam");
+    s(sprite,             "ppu.sprite");
+    s(a12.last_high,      "ppu.a12_last_high");
+    s(a12.vaddr_high,     "ppu.a12_vaddr_high");
+    if (s.loading())
+        a12_update();
 }
 
 u8 PPU::readreg(u16 addr)
@@ -121,6 +174,7 @@ u8 PPU::readreg(u16 addr)
         } else
             io.latch = bus->read(vram.addr.as_u14());
         vram.addr += (1UL << 5*io.vram_inc);
+        a12_vaddr();
         break;
 
 #ifdef DEBUG
@@ -146,6 +200,7 @@ void PPU::writereg(u16 addr, u8 data)
         io.sp_size      = (data & 0x20) >> 5;
         io.ext_bus_dir  = data & 0x40;
         io.nmi_enabled  = data & 0x80;
+        a12_update();
         break;
 
     // PPUMASK
@@ -194,6 +249,7 @@ void PPU::writereg(u16 addr, u8 data)
         else {
             vram.tmp = bits::setbits(vram.tmp.v, 0, 8, data);
             vram.addr = vram.tmp;
+            a12_vaddr();
         }
         io.scroll_latch ^= 1;
         break;
@@ -202,6 +258,7 @@ void PPU::writereg(u16 addr, u8 data)
     case 0x2007:
         bus->write(vram.addr.as_u14(), data);
         vram.addr += (1UL << 5*io.vram_inc);
+        a12_vaddr();
         break;
 
 #ifdef DEBUG
@@ -212,6 +269,47 @@ void PPU::writereg(u16 addr, u8 data)
     }
 }
 
+void PPU::a12_update()
+{
+    a12.fast_dot = 0;
+    a12.exact    = false;
+    if (!a12_callback)
+        return;
+    // first sprite pattern fetch, or first background fetch for the next line
+    if (io.sp_size == 0 && io.bg_pt_addr != io.sp_pt_addr)
+        a12.fast_dot = io.sp_pt_addr ? 261 : 325;
+    // with both tables at $0000, A12 never goes high while rendering
+    else if (io.sp_size == 1 || io.bg_pt_addr)
+        a12.exact = true;
+}
+
+// the mapper only sees an edge if A12 stayed low for a while (about three
+// CPU cycles); this filters out the gaps between background fetches.
+void PPU::a12_fetch(bool high)
+{
+    constexpr unsigned FRAME_DOTS = PPU_MAX_LINES * PPU_MAX_LCYCLE;
+    constexpr unsigned FILTER     = 10;
+    if (!high)
+        return;
+    unsigned now = lines * PPU_MAX_LCYCLE + cycles;
+    unsigned low_for = (now + FRAME_DOTS - a12.last_high) % FRAME_DOTS;
+    a12.last_high = now;
+    if (low_for >= FILTER)
+        a12_callback();
+}
+
+// outside of rendering the PPU keeps the vram address on the bus, so games
+// can also clock the counter by writing to PPUADDR.
+void PPU::a12_vaddr()
+{
+    if (!a12_callback)
+        return;
+    bool high = vram.addr.v & 0x1000;
+    if (high && !a12.vaddr_high)
+        a12_callback();
+    a12.vaddr_high = high;
+}
+
 void PPU::copy_v_horzpos()
 {
     vram.addr.coarse_x = vram.tmp.coarse_x;
@@ -235,7 +333,7 @@ void PPU::copy_v_vertpos()
 u8 PPU::fetch_nt(u15 vram_addr)
 {
     u16 addr = 0x2000 | (vram_addr & 0x0FFF);
-    return bus->read(addr);
+    return nametable(addr);
 }
 
 /*
@@ -246,7 +344,7 @@ u8 PPU::fetch_nt(u15 vram_addr)
 u8 PPU::fetch_attr(u16 nt, u16 coarse_y, u16 coarse_x)
 {
     u16 addr = 0x23C0 | nt << 10 | (coarse_y & 0x1C) << 1 | (coarse_x & 0x1C) >> 2;
-    return bus->read(addr);
+    return nametable(addr);
 }
 
 /*
@@ -260,15 +358,21 @@ u8 PPU::fetch_attr(u16 nt, u16 coarse_y, u16 coarse_x)
  */
 u8 PPU::fetch_pt(bool base, u8 nt, bool bitplane, u3 fine_y)
 {
+    if (a12.exact)
+        a12_fetch(base);
     u16 addr = base << 12 | nt << 4 | bitplane << 3 | fine_y;
-    return bus->read(addr);
+    return mapper->read_chr(addr);
 }
 
 // This function checks for sprite size and row before fetching from the pattern table
 u8 PPU::fetch_pt_sprite(bool sp_size, u8 nt, bool bitplane, unsigned row)
 {
-    if (row > 16)
+    if (row > 16) {
+        // empty slots still fetch tile $FF
+        if (a12.exact)
+            a12_fetch(sp_size ? nt & 1 : io.sp_pt_addr);
         return 0;
+    }
     if (!sp_size)
         return fetch_pt(io.sp_pt_addr, nt, bitplane, row);
     unsigned bit = bits::getbit(row, 3);
@@ -415,7 +519,8 @@ void PPU::render()
     auto x = cycles;
     auto y = lines;
     u8 pixel = output(x);
-    screen->output(x-1, y, pixel);
+    if (output_enabled)
+        screen->output(x-1, y, pixel);
 }
 
 void PPU::vblank_begin()
@@ -9,13 +9,17 @@
 #include <emu/util/array.hpp>
 #include <emu/util/uint.hpp>
 #include <emu/util/bits.hpp>
+#include <emu/util/serializer.hpp>
 
 class Screen;
 template <std::size_t Size> class Bus;
 namespace debugger { class PPUDebugger; }
+class PPUBench;
 
 namespace core {
 
+struct Mapper;
+
 class PPU {
 public:
     union VRAMAddress {
@@ -39,10 +43,14 @@ public:
 private:
     Bus<PPUBUS_SIZE> *bus;
     Screen *screen;
+    Mapper *mapper = nullptr;
+    std::array<u8 *, 4> nametables;
     unsigned cycles = 0;
     unsigned lines  = 0;
     std::function<void(bool)> nmi_callback;
+    std::function<void()> a12_callback;
     bool odd_frame;
+    bool output_enabled = true;
 
     struct {
         // used as internal buffer with regs I/O
@@ -130,6 +138,17 @@ private:
         u8 x;
     } sprite;
 
+    // A12 edges, for mappers that count scanlines. with 8x8 sprites and the
+    // background on the other pattern table, A12 rises once per rendered
+    // line, at a fixed dot, and nothing else needs to be looked at. any other
+    // setup makes us watch each pattern fetch instead.
+    struct {
+        unsigned fast_dot = 0;      // 0 = not fixed
+        bool exact = false;
+        unsigned last_high = 0;     // dot of the last fetch with A12 high
+        bool vaddr_high = false;    // A12 of the vram address, outside rendering
+    } a12;
+
 public:
     PPU(Bus<PPUBUS_SIZE> *vrambus, Screen *scr)
         : bus(vrambus), screen(scr)
@@ -138,7 +157,16 @@ public:
     void power(bool reset);
     u8 readreg(u16 addr);
     void writereg(u16 addr, u8 data);
+    void serialize(util::Serializer &s);
     void on_nmi(auto &&callback) { nmi_callback = callback; }
+    void on_a12(auto &&callback) { a12_callback = callback; a12_update(); }
+    // pattern fetches go straight to the mapper, without the bus
+    void set_mapper(Mapper *m)   { mapper = m; }
+    // the four 1 KiB nametables, as wired by the cartridge. changing
+    // mirroring is just a matter of changing these.
+    void map_nametables(u8 *p0, u8 *p1, u8 *p2, u8 *p3) { nametables = { p0, p1, p2, p3 }; }
+    u8 & nametable(u16 addr)     { return nametables[addr >> 10 & 3][addr & 0x3FF]; }
+    void enable_output(bool value) { output_enabled = value; }
 
     // ppumain.cpp
     void run();
@@ -151,6 +179,10 @@ private:
         lines %= PPU_MAX_LINES;
     }
 
+    void a12_update();
+    void a12_fetch(bool high);
+    void a12_vaddr();
+
     void copy_v_horzpos();
     void copy_v_vertpos();
 
@@ -180,6 +212,7 @@ private:
     void vblank_end();
 
     friend class debugger::PPUDebugger;
+    friend class ::PPUBench;
 };
 
 } // namespace core
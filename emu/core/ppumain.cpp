@@ -87,6 +87,12 @@ void PPU::cycle(unsigned line)
         }
     }
 
+    // A12 rises even if only one of the two layers is shown
+    if constexpr(Cycle == 261 || Cycle == 325) {
+        if (a12.fast_dot == Cycle && (io.bg_show || io.sp_show))
+            a12_callback();
+    }
+
     if (io.sp_show && line != 261) {
         if constexpr(Cycle >= 1 && Cycle <= 64) {
             if constexpr(Cycle == 1) { oam.read_ff = 1; secondary_oam.index = 0; }
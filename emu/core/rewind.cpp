@@ -0,0 +1,194 @@
+#include "rewind.hpp"
+
+#include <algorithm>
+
+namespace core {
+
+namespace {
+
+// zero runs shorter than this are stored as literals
+constexpr std::size_t MIN_RUN = 8;
+
+constexpr std::size_t worst_case_size(std::size_t n)
+{
+    // a token is at most two 3-byte lengths, and every token after
+    // the first starts with at least MIN_RUN zeroes
+    return n + 6 * (n / MIN_RUN + 1);
+}
+
+void put_length(std::vector<u8> &out, std::size_t n)
+{
+    while (n >= 0x80) {
+        out.push_back((n & 0x7F) | 0x80);
+        n >>= 7;
+    }
+    out.push_back(n);
+}
+
+std::size_t get_length(const u8 *&p)
+{
+    std::size_t n = 0;
+    for (unsigned shift = 0; ; shift += 7) {
+        u8 b = *p++;
+        n |= std::size_t(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return n;
+    }
+}
+
+/*
+ * XORs data with ref, then encodes the result as a list of tokens of the
+ * form (zero run length, literal length, literal bytes). An empty ref
+ * encodes data as it is (that's how keyframes are stored).
+ */
+void encode(std::span<const u8> data, std::span<const u8> ref, std::vector<u8> &out)
+{
+    const auto get = [&](std::size_t i) -> u8 { return ref.empty() ? data[i] : data[i] ^ ref[i]; };
+    const std::size_t n = data.size();
+    out.clear();
+    for (std::size_t i = 0; i < n; ) {
+        std::size_t lit_start = i;
+        while (lit_start < n && get(lit_start) == 0)
+            lit_start++;
+        // extend the literal until we find a long enough zero run
+        std::size_t lit_end = lit_start;
+        while (lit_end < n) {
+            if (get(lit_end) != 0) {
+                lit_end++;
+                continue;
+            }
+            std::size_t run = lit_end;
+            while (run < n && run - lit_end < MIN_RUN && get(run) == 0)
+                run++;
+            if (run - lit_end >= MIN_RUN || run == n)
+                break;
+            lit_end = run;
+        }
+        put_length(out, lit_start - i);
+        put_length(out, lit_end - lit_start);
+        for (std::size_t j = lit_start; j < lit_end; j++)
+            out.push_back(get(j));
+        i = lit_end;
+    }
+}
+
+// decodes and XORs the result onto out.
+void decode(std::span<const u8> in, std::span<u8> out)
+{
+    const u8 *p = in.data();
+    const u8 *end = p + in.size();
+    std::size_t pos = 0;
+    while (p < end) {
+        pos += get_length(p);
+        std::size_t len = get_length(p);
+        for (std::size_t i = 0; i < len; i++)
+            out[pos + i] ^= p[i];
+        p   += len;
+        pos += len;
+    }
+}
+
+bool overlaps(std::size_t start1, std::size_t size1, std::size_t start2, std::size_t size2)
+{
+    return start1 < start2 + size2 && start2 < start1 + size1;
+}
+
+} // namespace
+
+void Rewinder::reset(std::size_t state_size, std::size_t max_frames, std::size_t max_bytes)
+{
+    if (max_frames == 0) {
+        entries.clear();
+        buf.clear();
+        return;
+    }
+    state.assign(state_size, 0);
+    keyframe.assign(state_size, 0);
+    encoded.reserve(worst_case_size(state_size));
+    // only what the entries point to is ever read, so the old contents
+    // can stay: with the same sizes as before, nothing is touched
+    buf.resize(std::max(max_bytes, worst_case_size(state_size) * 2));
+    // popping a keyframe also pops the frames depending on it, so make space
+    // for a full interval more than requested.
+    entries.assign(max_frames + KEYFRAME_INTERVAL, Entry{});
+    clear();
+}
+
+void Rewinder::clear()
+{
+    first = count = write_pos = 0;
+    since_keyframe = 0;
+}
+
+void Rewinder::pop_oldest()
+{
+    // deltas are useless without their keyframe, so pop them too
+    do {
+        first = (first + 1) % entries.size();
+        count--;
+    } while (count > 0 && !entry(0).keyframe);
+}
+
+bool Rewinder::allocate(std::size_t size)
+{
+    if (size > buf.size())
+        return false;
+    if (count == 0)
+        write_pos = 0;
+    if (write_pos + size > buf.size()) {
+        // the entries after write_pos are the oldest ones; drop them and wrap around
+        while (count > 0 && entry(0).offset >= write_pos)
+            pop_oldest();
+        write_pos = 0;
+    }
+    while (count > 0 && (count >= entries.size() || overlaps(entry(0).offset, entry(0).size, write_pos, size)))
+        pop_oldest();
+    return true;
+}
+
+void Rewinder::push()
+{
+    if (!enabled())
+        return;
+    bool is_key = count == 0 || since_keyframe + 1 >= KEYFRAME_INTERVAL;
+    encode(state, is_key ? std::span<const u8>{} : keyframe, encoded);
+    if (!allocate(encoded.size()))
+        return;
+    if (!is_key && since_keyframe >= count) {
+        // the keyframe this delta was made against got thrown away
+        is_key = true;
+        encode(state, {}, encoded);
+        allocate(encoded.size());
+    }
+    std::copy(encoded.begin(), encoded.end(), buf.begin() + write_pos);
+    entry(count) = { .offset = write_pos, .size = encoded.size(), .keyframe = is_key };
+    count++;
+    write_pos += encoded.size();
+    if (is_key) {
+        std::copy(state.begin(), state.end(), keyframe.begin());
+        since_keyframe = 0;
+    } else
+        since_keyframe++;
+}
+
+std::optional<std::span<const u8>> Rewinder::rewind(std::size_t n)
+{
+    if (n >= count)
+        return std::nullopt;
+    const auto data = [&](const Entry &e) { return std::span<const u8>{buf.data() + e.offset, e.size}; };
+    std::size_t target = count - 1 - n;
+    std::size_t key = target;
+    while (!entry(key).keyframe)
+        key--;
+    std::fill(keyframe.begin(), keyframe.end(), 0);
+    decode(data(entry(key)), keyframe);
+    std::copy(keyframe.begin(), keyframe.end(), state.begin());
+    if (key != target)
+        decode(data(entry(target)), state);
+    count          = target + 1;
+    since_keyframe = target - key;
+    write_pos      = entry(target).offset + entry(target).size;
+    return state;
+}
+
+} // namespace core
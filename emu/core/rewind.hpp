@@ -0,0 +1,66 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <vector>
+#include <emu/util/common.hpp>
+
+/*
+ * Rewind support. The emulator saves a snapshot of the machine at the end of
+ * every frame; the rewinder keeps the last max_frames of them.
+ * Snapshots are stored as a XOR delta against the last keyframe, which is
+ * mostly zeroes as most of RAM and VRAM doesn't change between frames. The
+ * zeroes are then run-length encoded. A full keyframe is stored every
+ * KEYFRAME_INTERVAL frames.
+ * All encoded snapshots live in a single buffer of fixed size: when it's
+ * full, the oldest snapshots are thrown away, so memory use is always bounded.
+ */
+
+namespace core {
+
+class Rewinder {
+    struct Entry {
+        std::size_t offset;
+        std::size_t size;
+        bool keyframe;
+    };
+
+    std::vector<u8> buf;
+    std::size_t write_pos = 0;
+    std::vector<Entry> entries;
+    std::size_t first = 0;
+    std::size_t count = 0;
+
+    std::vector<u8> state;
+    std::vector<u8> keyframe;
+    std::vector<u8> encoded;
+    unsigned since_keyframe = 0;
+
+    Entry & entry(std::size_t i) { return entries[(first + i) % entries.size()]; }
+    bool allocate(std::size_t size);
+    void pop_oldest();
+
+public:
+    static constexpr unsigned KEYFRAME_INTERVAL = 60;
+
+    void reset(std::size_t state_size, std::size_t max_frames, std::size_t max_bytes);
+    void clear();
+    bool enabled() const            { return !entries.empty(); }
+    std::size_t size() const        { return count; }
+    std::size_t memory_used() const
+    {
+        return buf.size() + entries.size() * sizeof(Entry)
+             + state.size() + keyframe.size() + encoded.capacity();
+    }
+
+    // the state to save must be written to the span returned by next_state(),
+    // then push() must be called.
+    std::span<u8> next_state() { return state; }
+    void push();
+
+    // returns the state saved n snapshots before the latest one and discards
+    // all the snapshots that follow it.
+    std::optional<std::span<const u8>> rewind(std::size_t n);
+};
+
+} // namespace core
@@ -0,0 +1,75 @@
+#include "romcache.hpp"
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <emu/util/crc32.hpp>
+
+namespace core {
+
+namespace {
+
+using FileId = std::tuple<dev_t, ino_t, off_t, time_t, long>;
+
+std::mutex mutex;
+std::map<FileId, std::weak_ptr<io::MappedFile>> files;
+std::unordered_multimap<u32, std::weak_ptr<io::MappedFile>> roms;
+
+RomCache::Handle find(u32 crc, const io::MappedFile &same_as)
+{
+    auto [first, last] = roms.equal_range(crc);
+    for (auto it = first; it != last; ) {
+        auto handle = it->second.lock();
+        if (!handle) {
+            it = roms.erase(it);
+            continue;
+        }
+        // a CRC32 match isn't proof enough
+        if (handle->size() == same_as.size() && std::memcmp(handle->data(), same_as.data(), handle->size()) == 0)
+            return handle;
+        ++it;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+RomCache::Handle RomCache::open(std::string_view path)
+{
+    std::lock_guard lock{mutex};
+    struct stat st;
+    if (::stat(std::string(path).c_str(), &st) < 0)
+        return nullptr;
+    FileId id{st.st_dev, st.st_ino, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+    if (auto it = files.find(id); it != files.end()) {
+        if (auto handle = it->second.lock())
+            return handle;
+        files.erase(it);
+    }
+
+    auto file = io::MappedFile::open(path);
+    if (!file)
+        return nullptr;
+    u32 crc = util::crc32({ file.value().data(), file.value().size() });
+    auto handle = find(crc, file.value());
+    if (!handle) {
+        handle = std::make_shared<io::MappedFile>(std::move(file.value()));
+        roms.emplace(crc, handle);
+    }
+    files[id] = handle;
+    return handle;
+}
+
+std::size_t RomCache::size()
+{
+    std::lock_guard lock{mutex};
+    std::size_t n = 0;
+    for (auto &[crc, rom] : roms)
+        n += !rom.expired();
+    return n;
+}
+
+} // namespace core
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <emu/util/common.hpp>
+#include <emu/util/io.hpp>
+
+/*
+ * Process-wide ROM cache. Every ROM file is mapped once, and all the
+ * emulator instances that run it share the mapping. Entries are keyed by
+ * the CRC32 of the whole file, so the same game found at two paths is
+ * mapped once too; files already seen are recognized by device, inode,
+ * size and modification time, without hashing them again.
+ * A mapping goes away when the last handle to it does.
+ */
+
+namespace core {
+
+class RomCache {
+public:
+    using Handle = std::shared_ptr<io::MappedFile>;
+
+    // returns nullptr on error, with errno set
+    static Handle open(std::string_view path);
+    // number of ROMs currently mapped
+    static std::size_t size();
+};
+
+} // namespace core
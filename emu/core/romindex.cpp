@@ -0,0 +1,233 @@
+#include "romindex.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <emu/util/io.hpp>
+#include <emu/util/sha1.hpp>
+
+namespace fs = std::filesystem;
+
+namespace core {
+
+namespace {
+
+constexpr char MAGIC[] = "YNESIDX";
+
+enum Flags : u8 {
+    Valid   = 1 << 0,
+    NES20   = 1 << 1,
+    Battery = 1 << 2,
+    Trainer = 1 << 3,
+    Fixed   = 1 << 4,
+};
+
+u64 read_le(const u8 *p, int bytes)
+{
+    u64 x = 0;
+    for (int i = 0; i < bytes; i++)
+        x |= u64(p[i]) << (i * 8);
+    return x;
+}
+
+void write_le(u8 *p, u64 x, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        p[i] = x >> (i * 8);
+}
+
+bool is_rom_file(const fs::path &path)
+{
+    auto ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".nes";
+}
+
+// returns the number of bytes read
+u64 read_rom(IndexEntry &entry, const fs::path &path)
+{
+    entry.valid = false;
+    auto file = io::MappedFile::open(path.string());
+    if (!file)
+        return 0;
+    auto cart = parse_cartridge(file.value());
+    if (!cart)
+        return file.value().size();
+    const auto &c = cart.value();
+    entry.valid       = true;
+    entry.crc         = c.crc;
+    util::SHA1 sha1;
+    sha1.update(c.prgrom);
+    sha1.update(c.chrrom);
+    entry.sha1        = sha1.finish();
+    entry.prgrom_size = c.prgrom.size();
+    entry.chrrom_size = c.chrrom.size();
+    entry.mapper      = c.mapper;
+    entry.format      = c.format;
+    entry.mirroring   = c.mirroring;
+    entry.battery     = c.has.battery;
+    entry.trainer     = c.has.trainer;
+    entry.fixed       = c.fixed_header;
+    return file.value().size();
+}
+
+} // namespace
+
+std::optional<RomIndex> RomIndex::load(std::string_view path)
+{
+    auto file = io::MappedFile::open(path);
+    if (!file || file.value().size() < HEADER_SIZE)
+        return std::nullopt;
+    const u8 *p = file.value().data();
+    if (std::memcmp(p, MAGIC, 7) != 0 || p[7] != VERSION)
+        return std::nullopt;
+    u64 count   = read_le(p + 8, 4);
+    u64 strsize = read_le(p + 12, 4);
+    if (file.value().size() != HEADER_SIZE + count * RECORD_SIZE + strsize)
+        return std::nullopt;
+    const char *strings = (const char *) p + HEADER_SIZE + count * RECORD_SIZE;
+
+    RomIndex index;
+    index.list.resize(count);
+    for (u64 i = 0; i < count; i++) {
+        const u8 *r = p + HEADER_SIZE + i * RECORD_SIZE;
+        auto &e = index.list[i];
+        u64 offset = read_le(r + 32, 4);
+        u64 length = read_le(r + 36, 4);
+        if (offset + length > strsize)
+            return std::nullopt;
+        e.path        = std::string(strings + offset, length);
+        e.mtime       = read_le(r, 8);
+        e.size        = read_le(r + 8, 8);
+        e.crc         = read_le(r + 16, 4);
+        e.prgrom_size = read_le(r + 20, 4);
+        e.chrrom_size = read_le(r + 24, 4);
+        e.mapper      = read_le(r + 28, 2);
+        e.valid       = r[30] & Flags::Valid;
+        e.format      = r[30] & Flags::NES20 ? Cartridge::Format::NES_2_0 : Cartridge::Format::iNES;
+        e.battery     = r[30] & Flags::Battery;
+        e.trainer     = r[30] & Flags::Trainer;
+        e.fixed       = r[30] & Flags::Fixed;
+        e.mirroring   = Mirroring(r[31]);
+        std::memcpy(e.sha1.data(), r + 40, e.sha1.size());
+    }
+    return index;
+}
+
+bool RomIndex::save(std::string_view path) const
+{
+    std::vector<u8> buf(HEADER_SIZE + list.size() * RECORD_SIZE);
+    std::string strings;
+    std::memcpy(buf.data(), MAGIC, 7);
+    buf[7] = VERSION;
+    write_le(buf.data() + 8, list.size(), 4);
+    for (std::size_t i = 0; i < list.size(); i++) {
+        u8 *r = buf.data() + HEADER_SIZE + i * RECORD_SIZE;
+        const auto &e = list[i];
+        write_le(r,      e.mtime, 8);
+        write_le(r + 8,  e.size, 8);
+        write_le(r + 16, e.crc, 4);
+        write_le(r + 20, e.prgrom_size, 4);
+        write_le(r + 24, e.chrrom_size, 4);
+        write_le(r + 28, e.mapper, 2);
+        r[30] = (e.valid   ? Flags::Valid   : 0)
+              | (e.format == Cartridge::Format::NES_2_0 ? Flags::NES20 : 0)
+              | (e.battery ? Flags::Battery : 0)
+              | (e.trainer ? Flags::Trainer : 0)
+              | (e.fixed   ? Flags::Fixed   : 0);
+        r[31] = u8(e.mirroring);
+        write_le(r + 32, strings.size(), 4);
+        write_le(r + 36, e.path.size(), 4);
+        std::memcpy(r + 40, e.sha1.data(), e.sha1.size());
+        strings += e.path;
+    }
+    write_le(buf.data() + 12, strings.size(), 4);
+
+    // write to a temporary file first, so that an interrupted write never
+    // leaves a broken index behind
+    auto tmppath = std::string(path) + ".tmp";
+    auto file = io::File::open(tmppath, io::Access::Write);
+    if (!file)
+        return false;
+    bool ok = std::fwrite(buf.data(), 1, buf.size(), file.value().data()) == buf.size()
+           && std::fwrite(strings.data(), 1, strings.size(), file.value().data()) == strings.size()
+           && std::fflush(file.value().data()) == 0;
+    file.reset();
+    if (!ok || std::rename(tmppath.c_str(), std::string(path).c_str()) != 0) {
+        std::remove(tmppath.c_str());
+        return false;
+    }
+    return true;
+}
+
+RomIndex::Stats RomIndex::update(std::string_view root, unsigned threads)
+{
+    auto start = std::chrono::steady_clock::now();
+    Stats stats;
+
+    std::unordered_map<std::string, const IndexEntry *> old;
+    for (const auto &e : list)
+        old[e.path] = &e;
+
+    // looking at the directory tree is cheap compared to reading files, so
+    // it's done on this thread. only new and changed files are queued.
+    std::vector<IndexEntry> found;
+    std::vector<std::size_t> queue;
+    std::error_code ec;
+    const fs::path rootpath{root};
+    for (auto it = fs::recursive_directory_iterator(rootpath, fs::directory_options::skip_permission_denied, ec);
+         it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec)
+            break;
+        if (!it->is_regular_file(ec) || !is_rom_file(it->path()))
+            continue;
+        struct stat st;
+        if (::stat(it->path().c_str(), &st) < 0)
+            continue;
+        IndexEntry entry;
+        entry.path  = it->path().lexically_relative(rootpath).generic_string();
+        entry.mtime = u64(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+        entry.size  = st.st_size;
+        if (auto p = old.find(entry.path); p != old.end() && p->second->mtime == entry.mtime && p->second->size == entry.size)
+            entry = *p->second;
+        else
+            queue.push_back(found.size());
+        found.push_back(std::move(entry));
+    }
+
+    stats.threads = threads != 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+    stats.threads = std::min<unsigned>(stats.threads, std::max<std::size_t>(queue.size(), 1));
+    std::atomic<std::size_t> next = 0;
+    std::atomic<u64> bytes = 0;
+    auto work = [&]() {
+        u64 n = 0;
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < queue.size(); ) {
+            auto &entry = found[queue[i]];
+            n += read_rom(entry, rootpath / entry.path);
+        }
+        bytes += n;
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < stats.threads; i++)
+        pool.emplace_back(work);
+    work();
+    for (auto &t : pool)
+        t.join();
+
+    list = std::move(found);
+    stats.files   = list.size();
+    stats.hashed  = queue.size();
+    stats.invalid = std::count_if(list.begin(), list.end(), [](const auto &e) { return !e.valid; });
+    stats.bytes   = bytes;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+} // namespace core
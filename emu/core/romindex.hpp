@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <emu/core/cartridge.hpp>
+#include <emu/core/const.hpp>
+#include <emu/util/uint.hpp>
+
+/*
+ * ROM library index. A directory tree is searched for .nes files, and the
+ * header of each one is parsed and its PRG and CHR ROM hashed (CRC32 and
+ * SHA-1, so entries can be matched against ROM databases), on as many
+ * threads as there are cores. The results are kept in an index file at the
+ * root of the tree, so that updating the index only looks at files whose
+ * size or modification time changed.
+ * The index file is made of a 16 byte header:
+ *     0-7   "YNESIDX" followed by the version
+ *     8-11  number of entries
+ *     12-15 size of the string table
+ * followed by one 60 byte record for each file:
+ *     0-7   modification time, in nanoseconds since the epoch
+ *     8-15  file size
+ *     16-19 CRC32 of the PRG and CHR ROM (the same one found in movies)
+ *     20-23 PRG ROM size, in bytes
+ *     24-27 CHR ROM size, in bytes (0 = CHR RAM)
+ *     28-29 mapper
+ *     30    flags (bit 0: valid ROM, bit 1: NES 2.0, bit 2: battery, bit 3: trainer,
+ *           bit 4: header fixed from the game database)
+ *     31    mirroring (as in core::Mirroring)
+ *     32-35 offset of the path in the string table
+ *     36-39 length of the path
+ *     40-59 SHA-1 of the PRG and CHR ROM
+ * and by the string table, which holds paths relative to the root.
+ * Files that aren't valid ROMs are kept, so they aren't looked at again.
+ * All numbers are little endian.
+ */
+
+namespace core {
+
+struct IndexEntry {
+    std::string path;
+    u64 mtime = 0;
+    u64 size = 0;
+    bool valid = false;
+    u32 crc = 0;
+    std::array<u8, 20> sha1 = {};
+    u32 prgrom_size = 0;
+    u32 chrrom_size = 0;
+    u16 mapper = 0;
+    Cartridge::Format format = Cartridge::Format::iNES;
+    Mirroring mirroring = Mirroring::Horizontal;
+    bool battery = false;
+    bool trainer = false;
+    bool fixed = false;
+};
+
+class RomIndex {
+    std::vector<IndexEntry> list;
+
+public:
+    static constexpr int HEADER_SIZE = 16;
+    static constexpr int RECORD_SIZE = 60;
+    static constexpr u8 VERSION = 2;
+    static constexpr std::string_view FILENAME = "yanesemu.index";
+
+    struct Stats {
+        unsigned long files = 0;    // files found
+        unsigned long hashed = 0;   // files read, because they were new or changed
+        unsigned long invalid = 0;  // files that aren't valid ROMs
+        u64 bytes = 0;              // bytes read
+        unsigned threads = 0;
+        double seconds = 0;
+    };
+
+    static std::optional<RomIndex> load(std::string_view path);
+    bool save(std::string_view path) const;
+    // brings the index up to date with the files under root. threads = 0
+    // means one per core.
+    Stats update(std::string_view root, unsigned threads = 0);
+    const std::vector<IndexEntry> & entries() const { return list; }
+};
+
+} // namespace core
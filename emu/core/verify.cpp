@@ -0,0 +1,102 @@
+#include "verify.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <fmt/core.h>
+#include <emu/core/emulator.hpp>
+#include <emu/util/hash.hpp>
+
+namespace core {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// lists at most this many differences for each field
+constexpr int MAX_DIFFS_PER_FIELD = 8;
+
+std::string describe(const util::Serializer::Field &field, std::span<const u8> a, std::span<const u8> b)
+{
+    const auto *p = a.data() + field.offset;
+    const auto *q = b.data() + field.offset;
+    if (field.size <= 8) {
+        u64 x = 0, y = 0;
+        std::memcpy(&x, p, field.size);
+        std::memcpy(&y, q, field.size);
+        return fmt::format("{}: {:0{}X} != {:0{}X}", field.name, x, field.size*2, y, field.size*2);
+    }
+    std::string str;
+    int count = 0;
+    for (std::size_t i = 0; i < field.size; i++) {
+        if (p[i] == q[i])
+            continue;
+        if (count++ < MAX_DIFFS_PER_FIELD)
+            str += fmt::format(" [{:04X}] {:02X} != {:02X};", i, p[i], q[i]);
+    }
+    return fmt::format("{}: {} bytes differ:{}{}", field.name, count, str,
+                       count > MAX_DIFFS_PER_FIELD ? " ..." : "");
+}
+
+std::string describe_framebuffer(std::span<const u8> a, std::span<const u8> b)
+{
+    const std::size_t pixel = sizeof(backend::RGB);
+    std::size_t count = 0, first = 0;
+    for (std::size_t i = 0; i < a.size(); i += pixel) {
+        if (std::memcmp(&a[i], &b[i], pixel) != 0 && count++ == 0)
+            first = i / pixel;
+    }
+    return fmt::format("framebuffer: {} pixels differ, first at ({}, {})",
+                       count, first % SCREEN_WIDTH, first / SCREEN_WIDTH);
+}
+
+} // namespace
+
+std::optional<VerifyResult> verify_movie(const Cartridge::Data &cart, std::string_view movie_path)
+{
+    std::unique_ptr<Emulator> emus[2];
+    std::vector<u8> states[2];
+    for (int i = 0; i < 2; i++) {
+        emus[i] = std::make_unique<Emulator>();
+        if (!emus[i]->insert_rom(cart) || !emus[i]->play_movie(movie_path))
+            return std::nullopt;
+        emus[i]->set_headless(true);
+        emus[i]->power();
+        states[i].resize(emus[i]->state_size());
+    }
+
+    VerifyResult res;
+    auto start = Clock::now();
+    for (bool done = false; !done; res.frames++) {
+        u64 hashes[2][2];
+        for (int i = 0; i < 2; i++) {
+            emus[i]->run_frame();
+            auto t = Clock::now();
+            emus[i]->save_state(states[i]);
+            hashes[i][0] = util::hash64(states[i]);
+            hashes[i][1] = util::hash64(emus[i]->framebuffer());
+            res.hash_seconds += std::chrono::duration<double>(Clock::now() - t).count();
+        }
+        u64 run[3] = { res.hash, hashes[0][0], hashes[0][1] };
+        res.hash = util::hash64({ (const u8 *) run, sizeof(run) });
+        done = emus[0]->movie_finished() || emus[1]->movie_finished();
+        if (hashes[0][0] == hashes[1][0] && hashes[0][1] == hashes[1][1]
+         && emus[0]->movie_finished() == emus[1]->movie_finished())
+            continue;
+
+        res.mismatch = res.frames;
+        for (const auto &field : emus[0]->state_layout())
+            if (std::memcmp(&states[0][field.offset], &states[1][field.offset], field.size) != 0)
+                res.diff.push_back(describe(field, states[0], states[1]));
+        if (hashes[0][1] != hashes[1][1])
+            res.diff.push_back(describe_framebuffer(emus[0]->framebuffer(), emus[1]->framebuffer()));
+        if (emus[0]->movie_finished() != emus[1]->movie_finished())
+            res.diff.push_back("the movie ended on one instance only");
+        res.frames++;
+        break;
+    }
+    res.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return res;
+}
+
+} // namespace core
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <emu/core/cartridge.hpp>
+#include <emu/util/common.hpp>
+
+/*
+ * Determinism verifier. Two emulator instances run the same input movie side
+ * by side; after every frame the state of both (CPU and PPU registers, RAM,
+ * VRAM, OAM, palette, mapper, controllers) and their framebuffers are hashed
+ * and compared. At the first frame where they differ, the two states are
+ * compared field by field to tell what went wrong.
+ */
+
+namespace core {
+
+struct VerifyResult {
+    unsigned long frames = 0;                   // frames checked
+    double seconds = 0;
+    double hash_seconds = 0;                    // time spent hashing
+    u64 hash = 0;                               // hash of the whole run
+    std::optional<unsigned long> mismatch;      // first frame that differs
+    std::vector<std::string> diff;
+};
+
+std::optional<VerifyResult> verify_movie(const Cartridge::Data &cart, std::string_view movie_path);
+
+} // namespace core
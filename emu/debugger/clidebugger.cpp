@@ -60,6 +60,7 @@ void CliDebugger::help()
                "unhold, uhb         stop holding button automatically\n"
                "trace, t:           trace and log instructions to a file\n"
                "stoptrace, str:     stop tracing instructions\n"
+               "rewind, rw:         go back a number of frames\n"
                "reset, r:           reset emulator\n",
                "quit, q:            quit the debugger\n");
 }
@@ -141,6 +142,14 @@ void CliDebugger::trace(std::string_view filename)
         std::perror("error");
 }
 
+void CliDebugger::rewind(int frames)
+{
+    if (frames <= 0)
+        throw ParseError(fmt::format("Invalid number of frames: {}.", frames));
+    if (!Debugger::rewind(frames))
+        fmt::print("Can't rewind {} frames.\n", frames);
+}
+
 static std::string parse_error_message(int which, std::string_view name, int num_params)
 {
     switch (which) {
@@ -189,6 +198,7 @@ bool CliDebugger::repl()
             Command{ "unhold",      "uhb",      &CliDebugger::unhold_button,                this },
             Command{ "trace",       "t",        &CliDebugger::trace,                        this },
             Command{ "stoptrace",   "str",      [&]() { tracer.stop(); }                         },
+            Command{ "rewind",      "rw",       &CliDebugger::rewind,                       this },
             Command{ "reset",       "r",        [&]() { reset_system(); }                        },
             Command{ "quit",        "q",        [&]() { quit = true; }                           }
         );
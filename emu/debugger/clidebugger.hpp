@@ -22,6 +22,7 @@ class CliDebugger : public Debugger {
     void disassemble_block(u16 start, u16 end);
     void trace(std::string_view filename);
     void stop_tracing();
+    void rewind(int frames);
 
     void breakpoint_single(u16 addr)              { breakpoint(addr, addr); }
     void read_addr(u16 addr, MemorySource source) { read_block(addr, addr, source); }
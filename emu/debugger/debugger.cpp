@@ -114,7 +114,7 @@ void Debugger::run(StepType step_type)
     const auto runloop = [&](auto &&check_step)
     {
         for ( ; program.running(); ) {
-            sys->run();
+            core::emulator.step();
             tracer.trace(cpu, ppu);
             if (got_error)
                 break;
@@ -187,13 +187,21 @@ std::function<void(u16, u8)> Debugger::write_to(MemorySource source)
 
 void Debugger::reset_system()
 {
-    sys->power(/* reset = */ true);
+    core::emulator.power(/* reset = */ true);
     report_callback((Event) { .type = Event::Type::Step, .u = { .point_id = 0 } });
 }
 
 void Debugger::hold_button(input::Button button, bool value)
 {
-    sys->port.device->hold(button, value);
+    sys->port1.device->hold(button, value);
+}
+
+bool Debugger::rewind(unsigned frames)
+{
+    if (!core::emulator.rewind(frames))
+        return false;
+    report_callback((Event) { .type = Event::Type::Step, .u = { .point_id = 0 } });
+    return true;
 }
 
 } // namespace Debugger
@@ -143,6 +143,7 @@ protected:
     std::function<void(u16, u8)> write_to(MemorySource source);
     void reset_system();
     void hold_button(input::Button button, bool value);
+    bool rewind(unsigned frames);
 };
 
 std::pair<std::string, int> disassemble(u8 id, u8 oplow, u8 ophigh);
@@ -152,6 +152,7 @@ namespace debugger {
     X(0xF1, sbc, indy) \
     X(0xF5, sbc, zerox) \
     X(0xF6, inc, zerox) \
+    X(0xF8, sed, impld) \
     X(0xF9, sbc, absy) \
     X(0xFD, sbc, absx) \
     X(0xFE, inc, absx) \
@@ -0,0 +1,221 @@
+#include "dumper.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <fmt/core.h>
+
+namespace {
+
+// the writer thread writes in chunks of this size
+constexpr std::size_t BUFFER_SIZE = 4 * 1024 * 1024;
+constexpr std::size_t WAV_HEADER_SIZE = 44;
+// the most samples a single frame can have
+constexpr std::size_t MAX_FRAME_SAMPLES = 4096;
+
+void put_u16(std::vector<u8> &buf, u16 x)
+{
+    buf.push_back(x);
+    buf.push_back(x >> 8);
+}
+
+void put_str(std::vector<u8> &buf, std::string_view s)
+{
+    buf.insert(buf.end(), s.begin(), s.end());
+}
+
+void write_le(u8 *p, u32 x, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        p[i] = x >> (i * 8);
+}
+
+// the 44 byte RIFF header of a 16 bit mono PCM file
+std::array<u8, WAV_HEADER_SIZE> wav_header(unsigned rate, u32 data_size)
+{
+    std::array<u8, WAV_HEADER_SIZE> h;
+    std::memcpy(&h[0], "RIFF", 4);
+    write_le(&h[4], data_size + WAV_HEADER_SIZE - 8, 4);
+    std::memcpy(&h[8], "WAVEfmt ", 8);
+    write_le(&h[16], 16, 4);        // size of the format chunk
+    write_le(&h[20], 1, 2);         // PCM
+    write_le(&h[22], 1, 2);         // channels
+    write_le(&h[24], rate, 4);
+    write_le(&h[28], rate * 2, 4);  // bytes per second
+    write_le(&h[32], 2, 2);         // bytes per sample
+    write_le(&h[34], 16, 2);        // bits per sample
+    std::memcpy(&h[36], "data", 4);
+    write_le(&h[40], data_size, 4);
+    return h;
+}
+
+} // namespace
+
+void Dumper::Stream::allocate(std::size_t slot_size)
+{
+    slots.resize(SLOTS);
+    for (u32 i = 0; i < SLOTS; i++) {
+        slots[i].reserve(slot_size);
+        free.push(std::span{&i, 1});
+    }
+    outbuf.reserve(BUFFER_SIZE + slot_size * 3);
+}
+
+bool Dumper::Stream::push(std::span<const u8> data)
+{
+    u32 slot;
+    if (free.pop(std::span{&slot, 1}) == 0) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // slots never grow, so this doesn't allocate
+    auto &buf = slots[slot];
+    buf.assign(data.begin(), data.begin() + std::min(data.size(), buf.capacity()));
+    full.push(std::span{&slot, 1});
+    max_queued = std::max(max_queued, full.size());
+    return true;
+}
+
+void Dumper::Stream::flush()
+{
+    if (outbuf.empty())
+        return;
+    std::fwrite(outbuf.data(), 1, outbuf.size(), file.value().data());
+    outbuf.clear();
+}
+
+bool Dumper::open_video(std::string_view path, unsigned w, unsigned h)
+{
+    auto file = io::File::open(path, io::Access::Write);
+    if (!file)
+        return false;
+    width  = w;
+    height = h;
+    video.file = std::move(file);
+    video.allocate(width * height * 3);
+    // 4:4:4, so that colors stay sharp. the frame rate is the exact NTSC one.
+    put_str(video.outbuf, fmt::format("YUV4MPEG2 W{} H{} F118125000:1965513 Ip A1:1 C444\n", width, height));
+    return true;
+}
+
+bool Dumper::open_audio(std::string_view path, unsigned rate)
+{
+    auto file = io::File::open(path, io::Access::Write);
+    if (!file)
+        return false;
+    sample_rate = rate;
+    audio.file = std::move(file);
+    audio.allocate(MAX_FRAME_SAMPLES * sizeof(i16));
+    // the sizes are filled in at the end
+    auto header = wav_header(sample_rate, 0);
+    audio.outbuf.assign(header.begin(), header.end());
+    return true;
+}
+
+void Dumper::video_frame(std::span<const u8> rgb)
+{
+    if (video.file && video.push(rgb))
+        wake.notify_one();
+}
+
+void Dumper::audio_frame(std::span<const i16> samples)
+{
+    if (audio.file && audio.push(std::span{(const u8 *) samples.data(), samples.size_bytes()}))
+        wake.notify_one();
+}
+
+void Dumper::start()
+{
+    if ((video.file || audio.file) && !writer.joinable())
+        writer = std::thread([this]() { writer_loop(); });
+}
+
+void Dumper::writer_loop()
+{
+    for (;;) {
+        bool busy = false;
+        if (video.file)
+            busy |= write_video();
+        if (audio.file)
+            busy |= write_audio();
+        if (busy)
+            continue;
+        if (stopping.load())
+            break;
+        std::unique_lock<std::mutex> lock{wake_mutex};
+        // a notification can come between the check and the wait, hence the timeout
+        wake.wait_for(lock, std::chrono::milliseconds(5));
+    }
+}
+
+bool Dumper::write_video()
+{
+    u32 slot;
+    if (video.full.pop(std::span{&slot, 1}) == 0)
+        return false;
+    const auto &rgb = video.slots[slot];
+    const std::size_t pixels = width * height;
+    put_str(video.outbuf, "FRAME\n");
+    std::size_t start = video.outbuf.size();
+    video.outbuf.resize(start + pixels * 3);
+    u8 *y = &video.outbuf[start];
+    u8 *u = y + pixels;
+    u8 *v = u + pixels;
+    // BT.601, limited range
+    for (std::size_t i = 0; i < pixels && i*3 + 2 < rgb.size(); i++) {
+        int r = rgb[i*3], g = rgb[i*3+1], b = rgb[i*3+2];
+        y[i] = (( 66*r + 129*g +  25*b + 128) >> 8) + 16;
+        u[i] = ((-38*r -  74*g + 112*b + 128) >> 8) + 128;
+        v[i] = ((112*r -  94*g -  18*b + 128) >> 8) + 128;
+    }
+    video.free.push(std::span{&slot, 1});
+    video.written.fetch_add(1, std::memory_order_relaxed);
+    if (video.outbuf.size() >= BUFFER_SIZE)
+        video.flush();
+    return true;
+}
+
+bool Dumper::write_audio()
+{
+    u32 slot;
+    if (audio.full.pop(std::span{&slot, 1}) == 0)
+        return false;
+    // samples are little endian on disk
+    const auto &buf = audio.slots[slot];
+    for (std::size_t i = 0; i + 1 < buf.size(); i += 2) {
+        i16 s;
+        std::memcpy(&s, &buf[i], 2);
+        put_u16(audio.outbuf, s);
+    }
+    audio.data_size += buf.size() & ~1;
+    audio.free.push(std::span{&slot, 1});
+    audio.written.fetch_add(1, std::memory_order_relaxed);
+    if (audio.outbuf.size() >= BUFFER_SIZE)
+        audio.flush();
+    return true;
+}
+
+void Dumper::finish_wav()
+{
+    auto header = wav_header(sample_rate, audio.data_size);
+    std::fseek(audio.file.value().data(), 0, SEEK_SET);
+    std::fwrite(header.data(), 1, header.size(), audio.file.value().data());
+}
+
+void Dumper::stop()
+{
+    if (writer.joinable()) {
+        stopping = true;
+        wake.notify_one();
+        writer.join();
+    }
+    if (video.file) {
+        video.flush();
+        video.file.reset();
+    }
+    if (audio.file) {
+        audio.flush();
+        finish_wav();
+        audio.file.reset();
+    }
+}
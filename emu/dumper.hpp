@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <emu/util/common.hpp>
+#include <emu/util/io.hpp>
+#include <emu/util/ringbuffer.hpp>
+
+/*
+ * Dumps video (as a Y4M file) and audio (as a WAV file) while the emulator
+ * runs. The emulator thread only copies each frame into one of a fixed set
+ * of preallocated slots and hands it over through a lock-free queue; a
+ * writer thread converts it and writes it out in large chunks. If the
+ * writer falls behind and there are no free slots left, the frame is
+ * dropped instead of making the emulator wait.
+ */
+
+class Dumper {
+public:
+    static constexpr std::size_t SLOTS = 64;
+
+    struct Stats {
+        u64 written;
+        u64 dropped;
+        std::size_t max_queued;
+    };
+
+private:
+    struct Stream {
+        std::optional<io::File> file;
+        std::vector<std::vector<u8>> slots;
+        util::RingBuffer<u32> free{SLOTS};
+        util::RingBuffer<u32> full{SLOTS};
+        std::vector<u8> outbuf;
+        u64 data_size = 0;
+        std::atomic<u64> written = 0;
+        std::atomic<u64> dropped = 0;
+        std::size_t max_queued = 0;
+
+        void allocate(std::size_t slot_size);
+        bool push(std::span<const u8> data);
+        void flush();
+        Stats stats() const { return { written.load(), dropped.load(), max_queued }; }
+    };
+
+    Stream video;
+    Stream audio;
+    unsigned width = 0, height = 0;
+    unsigned sample_rate = 0;
+
+    std::thread writer;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::atomic<bool> stopping = false;
+
+    void writer_loop();
+    bool write_video();
+    bool write_audio();
+    void finish_wav();
+
+public:
+    Dumper() = default;
+    Dumper(const Dumper &) = delete;
+    Dumper & operator=(const Dumper &) = delete;
+    ~Dumper() { stop(); }
+
+    bool open_video(std::string_view path, unsigned width, unsigned height);
+    bool open_audio(std::string_view path, unsigned rate);
+    // starts the writer thread. the files must be opened before.
+    void start();
+    // writes out everything still queued and closes the files.
+    void stop();
+
+    // video frames are in RGB.
+    void video_frame(std::span<const u8> rgb);
+    void audio_frame(std::span<const i16> samples);
+
+    bool dumping_video() const { return !video.slots.empty(); }
+    bool dumping_audio() const { return !audio.slots.empty(); }
+    Stats video_stats() const  { return video.stats(); }
+    Stats audio_stats() const  { return audio.stats(); }
+};
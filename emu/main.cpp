@@ -1,13 +1,25 @@
+#include <chrono>
+#include <filesystem>
 #include <stdexcept>
+#include <thread>
 #include <fmt/core.h>
 #include <emu/version.hpp>
 #include <emu/program.hpp>
+#include <emu/shmexport.hpp>
+#include <emu/core/benchmark.hpp>
 #include <emu/core/cartridge.hpp>
 #include <emu/core/emulator.hpp>
+#include <emu/core/netplay.hpp>
+#include <emu/core/patch.hpp>
+#include <emu/core/romcache.hpp>
+#include <emu/core/romindex.hpp>
+#include <emu/core/verify.hpp>
 #include <emu/debugger/clidebugger.hpp>
 #include <emu/util/cmdline.hpp>
 #include <emu/util/debug.hpp>
+#include <emu/util/hash.hpp>
 #include <emu/util/io.hpp>
+#include <emu/util/socket.hpp>
 #include <emu/util/conf.hpp>
 #include <emu/util/string.hpp>
 #include <emu/util/utility.hpp>
@@ -18,6 +30,21 @@ static const std::vector<cmdline::Argument> cmdflags = {
     { 'd', "debugger", "Use command-line debugger"     },
     { 'n', "no-video", "Start without a window"        },
     { 's', "window-size", "Specify window size (1, 2, 3, 4)", cmdline::ParamType::Single, "2" },
+    { 'r', "run-ahead",   "Run ahead a number of frames to reduce input latency (1, 2, 3, 4)", cmdline::ParamType::Single, "1" },
+    { 'm', "movie",       "Play back an input movie, then quit", cmdline::ParamType::Single, "" },
+    { 'R', "record",      "Record input to a movie file", cmdline::ParamType::Single, "" },
+    { 'V', "verify",      "Play a movie on two instances, checking every frame that they stay identical, then quit", cmdline::ParamType::Single, "" },
+    { 'N', "netplay",     "Play online (format: PLAYER:LOCALPORT:HOST:PORT)", cmdline::ParamType::Single, "" },
+    { 'T', "netplay-test", "Test netplay on localhost with simulated latency and packet loss, then quit (format: LATENCY_MS:LOSS_PERCENT)", cmdline::ParamType::Single, "100:5" },
+    { 'D', "dump-video",  "Write video to a Y4M file", cmdline::ParamType::Single, "" },
+    { 'A', "dump-audio",  "Write audio to a WAV file", cmdline::ParamType::Single, "" },
+    { 'b', "batch",       "Run each ROM given for N frames, one after the other on the same instance, without video or audio, then quit", cmdline::ParamType::Single, "600" },
+    { 'B', "boot-cache",  "Start from the state N frames after power on, cached in ~/.cache/yanesemu", cmdline::ParamType::Single, "60" },
+    { 'P', "patch",       "Apply an IPS or BPS patch to the ROM when loading it", cmdline::ParamType::Single, "" },
+    { 'I', "index",       "Index the ROMs found in a directory and its subdirectories, then quit", cmdline::ParamType::Single, "." },
+    { 'x', "bench",       "Run as fast as possible without video or audio, then print a JSON performance report (use with --frames and --movie)" },
+    { 'f', "frames",      "Number of frames to run for --bench", cmdline::ParamType::Single, "600" },
+    { 'S', "shm",         "Publish every frame, RAM and input to a shared memory object (e.g. /yanesemu)", cmdline::ParamType::Single, "" },
 };
 
 static const conf::ValidConfig valid_conf = {
@@ -29,25 +56,56 @@ static const conf::ValidConfig valid_conf = {
     { "RightKey",  conf::Value("Key_Right") },
     { "StartKey",  conf::Value("Key_s")     },
     { "SelectKey", conf::Value("Key_a")     },
+    { "RewindSeconds",    conf::Value(10)   },
+    { "RewindBufferSize", conf::Value(4096) },
 };
 
 static conf::Data config;
 
 
 
+// maps the ROM file, applying a patch to it if one was given
 [[nodiscard]]
-io::MappedFile open_rom(std::string_view rompath)
+core::RomCache::Handle map_rom(std::string_view rompath, cmdline::Result &flags)
 {
-    auto romfile = io::MappedFile::open(rompath);
-    if (!romfile)
-        throw std::runtime_error(fmt::format("couldn't open {}: {}", rompath, util::system_error_string()));
-    auto cart = core::parse_cartridge(romfile.value());
+    if (!flags.has('P')) {
+        auto romfile = core::RomCache::open(rompath);
+        if (!romfile)
+            throw std::runtime_error(fmt::format("couldn't open {}: {}", rompath, util::system_error_string()));
+        return romfile;
+    }
+    core::PatchInfo info;
+    auto patched = core::patch_rom(rompath, flags.params['P'], info);
+    if (!patched)
+        throw std::runtime_error(fmt::format("couldn't apply patch {}: {}", flags.params['P'], info.error));
+    fmt::print(stderr, "{} patch: {} records applied in {:.3f} ms, {} KiB ROM, {} KiB copied ({} pages)\n",
+               info.format, info.records, info.seconds * 1000.0, info.size / 1024,
+               info.pages * info.page_size / 1024, info.pages);
+    return std::make_shared<io::MappedFile>(std::move(patched.value()));
+}
+
+[[nodiscard]]
+core::RomCache::Handle open_rom(cmdline::Result &flags)
+{
+    auto rompath = flags.items[0];
+    auto romfile = map_rom(flags.items[0], flags);
+    auto cart = core::parse_cartridge(*romfile);
     if (!cart)
-        throw std::runtime_error(fmt::format("not a real NES ROM: {}", romfile.value().filename()));
+        throw std::runtime_error(fmt::format("not a real NES ROM: {}", romfile->filename()));
     fmt::print("{}\n", cart.value().to_string());
     if (!core::emulator.insert_rom(cart.value()))
         throw std::runtime_error(fmt::format("mapper {} not supported", cart.value().mapper));
-    return std::move(romfile.value());
+    // movies always start from zeroed PRG RAM, which the movie file has no
+    // record of: playing one back from whatever a save file holds would
+    // give a different run, and recording one would change the save file
+    if (cart.value().has.battery && (flags.has('m') || flags.has('R')))
+        fmt::print(stderr, "movie: not using the save file, PRG RAM starts zeroed\n");
+    else if (cart.value().has.battery) {
+        auto savepath = std::filesystem::path(rompath).replace_extension(".sav").string();
+        if (!core::emulator.use_save_file(savepath))
+            warning("couldn't open save file {}: {}\n", savepath, util::system_error_string());
+    }
+    return romfile;
 }
 
 int get_window_size(cmdline::Result &flags)
@@ -60,30 +118,364 @@ int get_window_size(cmdline::Result &flags)
     throw std::runtime_error("Invalid value for viewport size (valid values: 1 2 3 4)");
 }
 
+int get_runahead(cmdline::Result &flags)
+{
+    if (!flags.has('r'))
+        return 0;
+    if (auto num = str::to_num(flags.params['r']);
+        num && num.value() >= 1 && num.value() <= 4)
+        return num.value();
+    throw std::runtime_error("Invalid value for run-ahead (valid values: 1 2 3 4)");
+}
+
+void open_movie(cmdline::Result &flags)
+{
+    if (flags.has('m') && flags.has('R'))
+        throw std::runtime_error("can't play and record a movie at the same time");
+    if (flags.has('m') && !core::emulator.play_movie(flags.params['m']))
+        throw std::runtime_error(fmt::format("couldn't play movie {}", flags.params['m']));
+    if (flags.has('R') && !core::emulator.record_movie(flags.params['R']))
+        throw std::runtime_error(fmt::format("couldn't open {}: {}", flags.params['R'], util::system_error_string()));
+}
+
+std::filesystem::path cache_dir()
+{
+    if (const char *dir = std::getenv("XDG_CACHE_HOME"); dir && dir[0] != '\0')
+        return std::filesystem::path(dir) / "yanesemu";
+    if (const char *home = std::getenv("HOME"); home && home[0] != '\0')
+        return std::filesystem::path(home) / ".cache" / "yanesemu";
+    return std::filesystem::temp_directory_path() / "yanesemu";
+}
+
+void boot(cmdline::Result &flags)
+{
+    if (!flags.has('B'))
+        return;
+    auto frames = str::to_num(flags.params['B']);
+    if (!frames || frames.value() < 0)
+        throw std::runtime_error("Invalid value for boot cache (must be a number of frames)");
+    auto info = core::emulator.boot(frames.value(), cache_dir().string());
+    if (info.cached)
+        fmt::print(stderr, "boot: state after {} frames loaded from {} in {:.3f} ms\n", frames.value(), info.path, info.seconds * 1000.0);
+    else
+        fmt::print(stderr, "boot: {} frames run in {:.3f} ms{}{}\n", frames.value(), info.seconds * 1000.0,
+                   info.path.empty() ? ", can't be cached" : ", state saved to ", info.path);
+}
+
+void open_dumps(cmdline::Result &flags)
+{
+    if (flags.has('D') && !program.dump_video(flags.params['D']))
+        throw std::runtime_error(fmt::format("couldn't open {}: {}", flags.params['D'], util::system_error_string()));
+    if (flags.has('A') && !program.dump_audio(flags.params['A'], core::emulator.sample_rate()))
+        throw std::runtime_error(fmt::format("couldn't open {}: {}", flags.params['A'], util::system_error_string()));
+}
+
+void print_dump_stats()
+{
+    const auto &dumper = program.dump_output();
+    const auto print = [](std::string_view what, Dumper::Stats st) {
+        fmt::print(stderr, "{} dump: {} frames written, {} dropped, at most {} of {} queued\n",
+                   what, st.written, st.dropped, st.max_queued, Dumper::SLOTS);
+    };
+    if (dumper.dumping_video())
+        print("video", dumper.video_stats());
+    if (dumper.dumping_audio())
+        print("audio", dumper.audio_stats());
+}
+
+std::optional<shm::Exporter> open_shm(cmdline::Result &flags)
+{
+    if (!flags.has('S'))
+        return std::nullopt;
+    auto exporter = shm::Exporter::create(flags.params['S']);
+    if (!exporter)
+        throw std::runtime_error(fmt::format("couldn't create shared memory {}: {}", flags.params['S'], util::system_error_string()));
+    return exporter;
+}
+
+std::optional<core::Netplay> open_netplay(cmdline::Result &flags)
+{
+    if (!flags.has('N'))
+        return std::nullopt;
+    auto parts = str::split_view(flags.params['N'], ':');
+    if (parts.size() != 4)
+        throw std::runtime_error("Invalid value for netplay (format: PLAYER:LOCALPORT:HOST:PORT)");
+    auto player     = str::to_num(parts[0]);
+    auto local_port = str::to_num(parts[1]);
+    auto port       = str::to_num(parts[3]);
+    if (!player || (player.value() != 1 && player.value() != 2))
+        throw std::runtime_error("Invalid player for netplay (valid values: 1 2)");
+    if (!local_port || !port)
+        throw std::runtime_error("Invalid port for netplay");
+    auto peer = io::Address::resolve(parts[2], port.value());
+    if (!peer)
+        throw std::runtime_error(fmt::format("couldn't resolve {}", parts[2]));
+    auto sock = io::UdpSocket::open(local_port.value());
+    if (!sock)
+        throw std::runtime_error(fmt::format("couldn't open port {}: {}", local_port.value(), util::system_error_string()));
+    return core::Netplay(core::emulator, std::move(sock.value()), {
+        .player = unsigned(player.value()),
+        .peer   = peer.value(),
+    });
+}
+
+void netplay_test(cmdline::Result &flags)
+{
+    auto parts = str::split_view(flags.params['T'], ':');
+    auto latency = parts.size() == 2 ? str::to_num(parts[0]) : std::nullopt;
+    auto loss    = parts.size() == 2 ? str::to_num(parts[1]) : std::nullopt;
+    if (!latency || !loss || latency.value() < 0 || loss.value() < 0 || loss.value() > 100)
+        throw std::runtime_error("Invalid value for netplay test (format: LATENCY_MS:LOSS_PERCENT)");
+    auto romfile = map_rom(flags.items[0], flags);
+    auto cart = core::parse_cartridge(*romfile);
+    if (!cart)
+        throw std::runtime_error(fmt::format("not a real NES ROM: {}", romfile->filename()));
+
+    const unsigned frames = 600;
+    auto res = core::netplay_loopback_test(cart.value(), latency.value(), loss.value(), frames);
+    if (!res)
+        throw std::runtime_error("couldn't start netplay test");
+    fmt::print("netplay test: {} frames, {} ms latency, {}% packet loss, {:.2f} s\n",
+               frames, latency.value(), loss.value(), res.value().seconds);
+    for (int i = 0; i < 2; i++) {
+        const auto &st = res.value().stats[i];
+        double game_seconds = st.frames / 60.0;
+        fmt::print("player {}: {} rollbacks ({:.2f}/s), {} frames re-simulated ({:.2f} per rollback), "
+                   "{:.3f} ms per re-simulated frame ({:.2f}% of the time budget), {} stalls, "
+                   "{} packets sent, {} dropped, {} received\n",
+                   i + 1, st.rollbacks, st.rollbacks / game_seconds,
+                   st.resim_frames, st.rollbacks ? double(st.resim_frames) / st.rollbacks : 0.0,
+                   st.resim_frames ? st.resim_time * 1000.0 / st.resim_frames : 0.0,
+                   st.resim_time / game_seconds * 100.0, st.stalls,
+                   st.packets_sent, st.packets_dropped, st.packets_received);
+    }
+    if (!res.value().states_match)
+        throw std::runtime_error("netplay test: the two sides ended up in different states");
+    fmt::print("final states match\n");
+}
+
+void verify(cmdline::Result &flags)
+{
+    auto romfile = map_rom(flags.items[0], flags);
+    auto cart = core::parse_cartridge(*romfile);
+    if (!cart)
+        throw std::runtime_error(fmt::format("not a real NES ROM: {}", romfile->filename()));
+    auto res = core::verify_movie(cart.value(), flags.params['V']);
+    if (!res)
+        throw std::runtime_error(fmt::format("couldn't play movie {}", flags.params['V']));
+    const auto &r = res.value();
+    fmt::print("verified {} frames in {:.2f} s ({:.1f} fps per instance), hashing: {:.1f} us per frame\n",
+               r.frames, r.seconds, r.frames / r.seconds, r.hash_seconds * 1e6 / r.frames);
+    if (r.mismatch) {
+        fmt::print("mismatch at frame {}:\n", r.mismatch.value());
+        for (const auto &line : r.diff)
+            fmt::print("    {}\n", line);
+        throw std::runtime_error("the two instances diverged");
+    }
+    fmt::print("run hash: {:016X}\n", r.hash);
+}
+
+// escapes a string for a JSON document
+std::string json_string(std::string_view str)
+{
+    std::string res = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            res += fmt::format("\\{}", c);
+        else if (u8(c) < 0x20)
+            res += fmt::format("\\u{:04x}", int(c));
+        else
+            res += c;
+    }
+    return res + "\"";
+}
+
+void bench(cmdline::Result &flags)
+{
+    auto frames = flags.has('f') ? str::to_num(flags.params['f']) : std::optional<int>(600);
+    if (!frames || frames.value() <= 0)
+        throw std::runtime_error("Invalid value for frames (must be a number of frames)");
+    auto romfile = map_rom(flags.items[0], flags);
+    auto cart = core::parse_cartridge(*romfile);
+    if (!cart)
+        throw std::runtime_error(fmt::format("not a real NES ROM: {}", romfile->filename()));
+    auto movie = flags.has('m') ? flags.params['m'] : std::string_view{};
+    auto res = core::run_benchmark(cart.value(), frames.value(), movie);
+    if (!res)
+        throw std::runtime_error(!movie.empty() ? fmt::format("couldn't play movie {}", movie)
+                                                : fmt::format("mapper {} not supported", cart.value().mapper));
+    const auto &r = res.value();
+    const double s = r.seconds > 0 ? r.seconds : 1;
+    fmt::print("{{\n"
+               "  \"rom\": {},\n"
+               "  \"crc\": \"{:08X}\",\n"
+               "  \"mapper\": {},\n"
+               "  \"movie\": {},\n"
+               "  \"frames\": {},\n"
+               "  \"wall_seconds\": {:.6f},\n"
+               "  \"fps\": {:.2f},\n"
+               "  \"cpu_instructions\": {},\n"
+               "  \"cpu_instructions_per_second\": {:.0f},\n"
+               "  \"ppu_dots\": {},\n"
+               "  \"ppu_dots_per_second\": {:.0f},\n"
+               "  \"frame_ms\": {{ \"p50\": {:.4f}, \"p99\": {:.4f}, \"max\": {:.4f} }},\n"
+               "  \"peak_rss_kib\": {}\n"
+               "}}\n",
+               json_string(flags.items[0]), cart.value().crc, cart.value().mapper,
+               movie.empty() ? "null" : json_string(movie), r.frames, r.seconds, r.frames / s,
+               r.instructions, r.instructions / s, r.dots, r.dots / s,
+               r.p50 * 1e3, r.p99 * 1e3, r.max * 1e3, r.peak_rss);
+}
+
+void index_roms(cmdline::Result &flags)
+{
+    auto dir = std::filesystem::path(flags.params['I']);
+    if (!std::filesystem::is_directory(dir))
+        throw std::runtime_error(fmt::format("{} is not a directory", dir.string()));
+    auto path = (dir / core::RomIndex::FILENAME).string();
+    auto index = core::RomIndex::load(path).value_or(core::RomIndex{});
+    auto st = index.update(dir.string());
+    if (!index.save(path))
+        throw std::runtime_error(fmt::format("couldn't write {}: {}", path, util::system_error_string()));
+    fmt::print("indexed {} files ({} ROMs, {} not valid) in {:.3f} s: {} read, {} unchanged\n",
+               st.files, st.files - st.invalid, st.invalid, st.seconds, st.hashed, st.files - st.hashed);
+    fmt::print("{:.0f} files/s, {:.1f} MiB/s read on {} threads\n",
+               st.files / st.seconds, st.bytes / st.seconds / (1024.0 * 1024.0), st.threads);
+}
+
+// one instance runs all the ROMs: everything that was set up for the
+// previous one is reused, including the state buffers when they're the
+// same size.
+void batch(cmdline::Result &flags)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto since = [](Clock::time_point t) { return std::chrono::duration<double>(Clock::now() - t).count(); };
+    auto frames = str::to_num(flags.params['b']);
+    if (!frames || frames.value() <= 0)
+        throw std::runtime_error("Invalid value for batch (must be a number of frames)");
+    // ROMs can also be listed in a file, one per line, passed as @file
+    std::vector<std::string> roms;
+    for (auto item : flags.items) {
+        if (!item.starts_with('@')) {
+            roms.emplace_back(item);
+            continue;
+        }
+        auto list = io::File::open(item.substr(1), io::Access::Read);
+        if (!list)
+            throw std::runtime_error(fmt::format("couldn't open {}: {}", item.substr(1), util::system_error_string()));
+        for (std::string line; ; ) {
+            bool more = list.value().get_line(line);
+            if (!line.empty())
+                roms.push_back(line);
+            if (!more)
+                break;
+        }
+    }
+    core::emulator.set_headless(true);
+    std::vector<u8> state;
+    double setup_time = 0, run_time = 0;
+    unsigned done = 0;
+    for (const auto &rompath : roms) {
+        auto start = Clock::now();
+        core::RomCache::Handle romfile;
+        try {
+            romfile = map_rom(rompath, flags);
+        } catch (const std::runtime_error &err) {
+            fmt::print(stderr, "{}: {}\n", rompath, err.what());
+            continue;
+        }
+        auto cart = core::parse_cartridge(*romfile);
+        if (!cart || !core::emulator.insert_rom(cart.value())) {
+            fmt::print(stderr, "{}: {}\n", rompath, !cart ? "not a real NES ROM" : "mapper not supported");
+            continue;
+        }
+        core::emulator.power();
+        double setup = since(start);
+        start = Clock::now();
+        for (long i = 0; i < frames.value(); i++)
+            core::emulator.run_frame();
+        double run = since(start);
+        state.resize(core::emulator.state_size());
+        core::emulator.save_state(state);
+        fmt::print("{}: mapper {}, setup {:.1f} us, {} frames in {:.1f} ms, state hash {:016X}\n",
+                   rompath, cart.value().mapper, setup * 1e6, frames.value(), run * 1e3, util::hash64(state));
+        setup_time += setup;
+        run_time += run;
+        done++;
+    }
+    if (done != 0)
+        fmt::print("{} of {} ROMs run: {:.1f} us setup and {:.1f} ms of emulation per ROM\n",
+                   done, roms.size(), setup_time * 1e6 / done, run_time * 1e3 / done);
+}
+
 void cli_interface(cmdline::Result &flags)
 {
+    if (flags.has('I'))
+        return index_roms(flags);
     if (flags.items.empty())
         throw std::runtime_error("ROM file not specified");
+    if (flags.has('b'))
+        return batch(flags);
     if (flags.items.size() > 1)
         warning("multiple ROM files specified, first one will be used\n");
 
+    if (flags.has('T'))
+        return netplay_test(flags);
+    if (flags.has('V'))
+        return verify(flags);
+    if (flags.has('x'))
+        return bench(flags);
+
     int window_size = get_window_size(flags);
+    int runahead = get_runahead(flags);
     auto name = flags.items[0];
-    auto rom = open_rom(name);
+    // the buffer size is in KiB. 60 frames = 1 second
+    core::emulator.set_rewind(std::max(config["RewindSeconds"].as<int>(), 0) * 60,
+                              std::max(config["RewindBufferSize"].as<int>(), 0) * 1024);
+    auto rom = open_rom(flags);
     program.start_video(name, flags);
+    program.start_audio(core::emulator.sample_rate(), flags);
+    open_dumps(flags);
+    auto exporter = open_shm(flags);
+    if (exporter) {
+        core::emulator.on_frame([&]() {
+            exporter.value().publish(core::emulator.framebuffer(), core::emulator.ram(),
+                                     core::keys_to_mask(core::emulator.keys(1)),
+                                     core::keys_to_mask(core::emulator.keys(2)));
+        });
+    }
     program.set_window_scale(window_size);
     program.use_config(config);
 
+    core::emulator.set_runahead(runahead);
+    open_movie(flags);
     core::emulator.power();
-    if (!flags.has('d')) {
+    boot(flags);
+    auto netplay = open_netplay(flags);
+    if (netplay) {
+        program.run([&]() {
+            while (program.running()) {
+                if (!netplay.value().run_frame(program.poll_input()))
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    } else if (!flags.has('d')) {
         core::emulator.on_cpu_error([&](u8 id, u16 addr) {
             fmt::print(stderr, "The CPU has found an invalid instruction of ID ${:02X} at address ${:04X}. Stopping.\n", id, addr);
             core::emulator.stop();
             program.stop();
         });
         program.run([&]() {
-            while (program.running())
+            double start = util::thread_cpu_time();
+            unsigned long frames = 0;
+            for ( ; program.running() && !core::emulator.movie_finished(); frames++)
                 core::emulator.run_frame();
+            program.stop();
+            if (core::emulator.movie_finished())
+                fmt::print("movie ended after {} frames\n", frames);
+            if (runahead != 0 && frames != 0)
+                fmt::print(stderr, "run-ahead: {} frames, {:.3f} ms of emulator thread time per displayed frame\n",
+                           runahead, (util::thread_cpu_time() - start) * 1000.0 / frames);
         });
     } else {
         program.run([&]() {
@@ -96,6 +488,15 @@ void cli_interface(cmdline::Result &flags)
     }
 
     program.start();
+    core::emulator.stop_movie();
+    core::emulator.sync_save();
+    print_dump_stats();
+    if (exporter && exporter.value().frames() != 0)
+        fmt::print(stderr, "shm: {} frames published, {:.1f} us per frame\n", exporter.value().frames(),
+                   exporter.value().time_used() * 1e6 / exporter.value().frames());
+    if (program.has_audio())
+        fmt::print(stderr, "audio: {} underruns, {} overruns\n",
+                   program.audio_output().underruns(), program.audio_output().overruns());
 }
 
 int main(int argc, char *argv[])
@@ -30,6 +30,25 @@ void Program::start_video(std::string_view rom_name, cmdline::Result &flags)
     });
 }
 
+void Program::start_audio(unsigned sample_rate, cmdline::Result &flags)
+{
+    audio_enabled = audio.open({
+        .input_rate = sample_rate,
+        // without video there's probably no one listening either
+        .driver     = flags.has('n') ? "dummy" : "",
+    });
+}
+
+bool Program::dump_video(std::string_view path)
+{
+    return dumper.open_video(path, core::SCREEN_WIDTH, core::SCREEN_HEIGHT);
+}
+
+bool Program::dump_audio(std::string_view path, unsigned sample_rate)
+{
+    return dumper.open_audio(path, sample_rate);
+}
+
 void Program::use_config(const conf::Data &conf)
 {
     using namespace std::literals;
@@ -56,7 +75,7 @@ void Program::set_window_scale(int size)
 
 input::Keys Program::poll_input()
 {
-    return video->get_curr_keys();
+    return video ? video->get_curr_keys() : input::Keys{};
 }
 
 void Program::render_loop()
@@ -80,10 +99,13 @@ void Program::render_loop()
         video->draw();
     }
     emulator_thread.join();
+    audio.close();
+    dumper.stop();
 }
 
 void Program::video_frame(std::span<const u8> data)
 {
+    dumper.video_frame(data);
     std::unique_lock<std::mutex> lock{frame_mutex};
     frame_pending += 1;
     video_data = data;
@@ -103,6 +125,13 @@ void Program::video_frame(std::span<const u8> data)
     // }
 }
 
+void Program::audio_frame(std::span<const i16> samples)
+{
+    if (audio_enabled)
+        audio.push(samples);
+    dumper.audio_frame(samples);
+}
+
 void Program::stop()
 {
     std::lock_guard<std::mutex> frame_lock(frame_mutex);
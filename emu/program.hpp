@@ -5,6 +5,8 @@
 #include <mutex>
 #include <condition_variable>
 #include <emu/backend/backend.hpp>
+#include <emu/backend/audio.hpp>
+#include <emu/dumper.hpp>
 #include <emu/util/conf.hpp>
 #include <emu/util/common.hpp>
 #include <emu/util/locked.hpp>
@@ -13,6 +15,9 @@
 class Program {
     std::unique_ptr<backend::Backend> video;
     u32 screen;
+    backend::Audio audio;
+    bool audio_enabled = false;
+    Dumper dumper;
     std::thread emulator_thread;
 
     std::mutex frame_mutex;
@@ -28,16 +33,24 @@ class Program {
 
 public:
     void start_video(std::string_view rom_name, cmdline::Result &flags);
+    void start_audio(unsigned sample_rate, cmdline::Result &flags);
     void use_config(const conf::Data &conf);
     void set_window_scale(int size);
     void stop();
 
-    void run(auto &&fn)             { emulator_thread = std::thread(fn); }
+    bool dump_video(std::string_view path);
+    bool dump_audio(std::string_view path, unsigned sample_rate);
+    const Dumper & dump_output() const { return dumper; }
+
+    void run(auto &&fn)             { dumper.start(); emulator_thread = std::thread(fn); }
     void start()                    { render_loop(); }
     bool running()                  { return state.access<bool>([](auto s) { return s == State::Running; }); }
 
     input::Keys poll_input();
     void video_frame(std::span<const u8> data);
+    void audio_frame(std::span<const i16> samples);
+    const backend::Audio & audio_output() const { return audio; }
+    bool has_audio() const { return audio_enabled; }
 };
 
 extern Program program;
@@ -0,0 +1,62 @@
+#include "shmexport.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace shm {
+
+std::optional<Exporter> Exporter::create(std::string_view name, u32 slots)
+{
+    auto mem = io::SharedMemory::create(name, region_size(slots));
+    if (!mem)
+        return std::nullopt;
+    auto *h = header(mem.value().data());
+    std::memset(mem.value().data(), 0, mem.value().size());
+    std::memcpy(h->magic, MAGIC, sizeof(MAGIC));
+    h->version   = VERSION;
+    h->slots     = slots;
+    h->slot_size = sizeof(Slot);
+    h->width     = core::SCREEN_WIDTH;
+    h->height    = core::SCREEN_HEIGHT;
+    h->ram_size  = core::RAM_SIZE;
+    std::atomic_ref(h->alive).store(1, std::memory_order_release);
+    return Exporter(std::move(mem.value()));
+}
+
+Exporter::~Exporter()
+{
+    if (!mem.data())
+        return;
+    auto *h = header(mem.data());
+    std::atomic_ref(h->alive).store(0, std::memory_order_release);
+    std::atomic_ref(h->doorbell).fetch_add(1, std::memory_order_release);
+    io::futex_wake_all(&h->doorbell);
+}
+
+void Exporter::publish(std::span<const u8> rgb, std::span<const u8> ram, u8 keys1, u8 keys2)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto *h = header(mem.data());
+    auto *s = slot(mem.data(), frame);
+    std::atomic_ref seq{s->seq};
+    u64 n = seq.load(std::memory_order_relaxed);
+    seq.store(n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s->frame     = frame;
+    s->timestamp = now_ns();
+    s->keys[0]   = keys1;
+    s->keys[1]   = keys2;
+    std::memcpy(s->ram, ram.data(), std::min(ram.size(), sizeof(s->ram)));
+    std::memcpy(s->rgb, rgb.data(), std::min(rgb.size(), sizeof(s->rgb)));
+    seq.store(n + 2, std::memory_order_release);
+    frame++;
+    std::atomic_ref(h->latest).store(frame, std::memory_order_release);
+    // seq_cst on both, or we could miss a reader that's just going to sleep
+    std::atomic_ref(h->doorbell).fetch_add(1, std::memory_order_seq_cst);
+    if (std::atomic_ref(h->waiters).load(std::memory_order_seq_cst) != 0)
+        io::futex_wake_all(&h->doorbell);
+    time_spent += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace shm
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <emu/core/const.hpp>
+#include <emu/util/common.hpp>
+#include <emu/util/shm.hpp>
+
+/*
+ * Publishes every frame (the RGB picture, the 2 KB of RAM and the input of
+ * both controllers) into a POSIX shared memory object, so that tools in
+ * other processes can follow the emulator. The object is a header
+ * followed by a ring of slots; frame N goes in slot N % slots.
+ * Each slot is guarded by a seqlock: the writer makes the sequence number
+ * odd, writes the slot, then makes it even again. A reader reads the
+ * sequence number, reads the data in place, and then checks that the
+ * number didn't change; if it did, the writer lapped it and the data must
+ * be thrown away. The writer never waits for readers.
+ * To avoid spinning, readers can sleep on the doorbell: a futex word that
+ * the writer bumps after each frame (it only makes the wake-up system call
+ * when someone is waiting).
+ */
+
+namespace shm {
+
+inline constexpr char MAGIC[8] = "YNESHM1";
+inline constexpr u32 VERSION = 1;
+
+struct alignas(64) Header {
+    char magic[8];
+    u32 version;
+    u32 slots;
+    u32 slot_size;
+    u32 width, height;
+    u32 ram_size;
+    u64 latest;         // number of the last published frame, plus one (0 = nothing yet)
+    u32 doorbell;       // futex word, bumped after each frame
+    u32 waiters;        // readers sleeping on the doorbell
+    u32 alive;          // cleared when the emulator quits
+};
+
+struct alignas(64) Slot {
+    u64 seq;            // odd while the slot is being written
+    u64 frame;
+    u64 timestamp;      // CLOCK_MONOTONIC in nanoseconds, at the time of publishing
+    u8 keys[2];         // same format as movies: A, B, Select, Start, Up, Down, Left, Right
+    u8 ram[core::RAM_SIZE];
+    u8 rgb[core::SCREEN_WIDTH * core::SCREEN_HEIGHT * 3];
+};
+
+inline constexpr std::size_t region_size(u32 slots) { return sizeof(Header) + sizeof(Slot) * slots; }
+
+inline Header *header(u8 *mem)     { return reinterpret_cast<Header *>(mem); }
+inline Slot *slot(u8 *mem, u64 i)  { return reinterpret_cast<Slot *>(mem + sizeof(Header)) + i % header(mem)->slots; }
+
+inline u64 now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return u64(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+// the writer side.
+class Exporter {
+    io::SharedMemory mem;
+    u64 frame = 0;
+    double time_spent = 0;
+
+    explicit Exporter(io::SharedMemory &&m) : mem(std::move(m)) { }
+
+public:
+    static constexpr u32 DEFAULT_SLOTS = 8;
+
+    ~Exporter();
+    Exporter(Exporter &&) = default;
+
+    static std::optional<Exporter> create(std::string_view name, u32 slots = DEFAULT_SLOTS);
+    void publish(std::span<const u8> rgb, std::span<const u8> ram, u8 keys1, u8 keys2);
+
+    u64 frames() const { return frame; }
+    // time spent publishing, in seconds
+    double time_used() const { return time_spent; }
+};
+
+} // namespace shm
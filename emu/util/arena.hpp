@@ -0,0 +1,100 @@
+#pragma once
+
+/*
+ * A memory arena: one block of memory, mapped at once, from which objects
+ * are carved one after the other. Nothing is freed on its own; the whole
+ * arena is emptied at once, and its memory is reused unless it has to
+ * grow. Memory handed out is zeroed and aligned to a cache line.
+ */
+
+#include <cstring>
+#include <memory>
+#include <new>
+#include <span>
+#include <utility>
+#include <sys/mman.h>
+#include "common.hpp"
+#include "debug.hpp"
+
+namespace util {
+
+// for unique_ptrs to objects living in an arena: the destructor is run,
+// but the memory stays with the arena.
+struct ArenaDelete {
+    template <typename T>
+    void operator()(T *p) const { p->~T(); }
+};
+
+template <typename T>
+using ArenaPtr = std::unique_ptr<T, ArenaDelete>;
+
+class Arena {
+    u8 *ptr = nullptr;
+    std::size_t cap = 0;
+    std::size_t used = 0;
+
+    void release()
+    {
+        if (ptr)
+            ::munmap(ptr, cap);
+        ptr = nullptr;
+        cap = used = 0;
+    }
+
+public:
+    static constexpr std::size_t ALIGN = 64;
+
+    Arena() = default;
+    explicit Arena(std::size_t capacity) { reset(capacity); }
+    ~Arena() { release(); }
+
+    Arena(const Arena &) = delete;
+    Arena & operator=(const Arena &) = delete;
+    Arena(Arena &&a) noexcept { operator=(std::move(a)); }
+    Arena & operator=(Arena &&a) noexcept
+    {
+        std::swap(ptr, a.ptr);
+        std::swap(cap, a.cap);
+        std::swap(used, a.used);
+        return *this;
+    }
+
+    // empties the arena and makes sure it can hold at least capacity bytes.
+    // objects still pointing into it must be gone by now.
+    void reset(std::size_t capacity)
+    {
+        used = 0;
+        if (capacity <= cap)
+            return;
+        release();
+        const std::size_t page = 4096;
+        capacity = (capacity + page - 1) / page * page;
+        auto *p = (u8 *) ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            panic("couldn't map {} bytes for an arena\n", capacity);
+        ptr = p;
+        cap = capacity;
+    }
+
+    std::span<u8> alloc(std::size_t size)
+    {
+        std::size_t start = (used + ALIGN - 1) / ALIGN * ALIGN;
+        if (start + size > cap)
+            panic("arena of {} bytes is full (asked for {} more)\n", cap, size);
+        used = start + size;
+        std::memset(ptr + start, 0, size);
+        return { ptr + start, size };
+    }
+
+    template <typename T, typename... Args>
+    ArenaPtr<T> make(Args&&... args)
+    {
+        static_assert(alignof(T) <= ALIGN);
+        return ArenaPtr<T>(new (alloc(sizeof(T)).data()) T(std::forward<Args>(args)...));
+    }
+
+    std::size_t capacity() const { return cap; }
+    std::size_t size() const     { return used; }
+};
+
+} // namespace util
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <span>
+#include "common.hpp"
+
+namespace util {
+
+namespace detail {
+
+// table k gives the CRC of a byte followed by k zero bytes, so that 8 bytes
+// can be done with 8 independent lookups (slicing-by-8).
+constexpr std::array<std::array<u32, 256>, 8> make_crc32_tables()
+{
+    std::array<std::array<u32, 256>, 8> tables;
+    for (u32 i = 0; i < 256; i++) {
+        u32 c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        tables[0][i] = c;
+    }
+    for (u32 i = 0; i < 256; i++)
+        for (int k = 1; k < 8; k++)
+            tables[k][i] = tables[0][tables[k-1][i] & 0xFF] ^ (tables[k-1][i] >> 8);
+    return tables;
+}
+
+inline constexpr std::array<std::array<u32, 256>, 8> crc32_tables = make_crc32_tables();
+
+} // namespace detail
+
+// standard CRC-32 (the one used by zip, png, etc.). pass a previous result
+// as crc to compute the checksum of multiple blocks of data.
+inline u32 crc32(std::span<const u8> data, u32 crc = 0)
+{
+    const auto &t = detail::crc32_tables;
+    const u8 *p = data.data();
+    std::size_t n = data.size();
+    crc = ~crc;
+    for ( ; n >= 8; p += 8, n -= 8) {
+        u32 lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        if constexpr (std::endian::native == std::endian::big) {
+            lo = __builtin_bswap32(lo);
+            hi = __builtin_bswap32(hi);
+        }
+        lo ^= crc;
+        crc = t[7][lo       & 0xFF] ^ t[6][lo >>  8 & 0xFF]
+            ^ t[5][lo >> 16 & 0xFF] ^ t[4][lo >> 24       ]
+            ^ t[3][hi       & 0xFF] ^ t[2][hi >>  8 & 0xFF]
+            ^ t[1][hi >> 16 & 0xFF] ^ t[0][hi >> 24       ];
+    }
+    for ( ; n > 0; p++, n--)
+        crc = t[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+} // namespace util
@@ -0,0 +1,117 @@
+#pragma once
+
+/*
+ * A fast non-cryptographic 64-bit hash, meant for comparing large blocks of
+ * memory (like whole machine states) every frame.
+ * The data is read in 32-byte blocks as four 64-bit lanes. For each lane the
+ * data is added to the neighbouring accumulator and the product of the two
+ * 32-bit halves of (data ^ key) is added to its own; the keys change with
+ * every block, so moving data around changes the hash. On x86 the lanes are
+ * processed with SSE2 (_mm_mul_epu32 is exactly the 32x32->64 multiply we
+ * need); the scalar version gives the same results.
+ */
+
+#include <cstring>
+#include <span>
+#include "common.hpp"
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+namespace util {
+
+namespace detail {
+
+inline constexpr u64 HASH_PRIME1 = 0x9E3779B185EBCA87ull;
+inline constexpr u64 HASH_PRIME2 = 0xC2B2AE3D27D4EB4Full;
+inline constexpr u64 HASH_PRIME3 = 0x165667B19E3779F9ull;
+inline constexpr u64 HASH_KEY_STEP = 0xD6E8FEB86659FD93ull;
+inline constexpr u64 hash_keys[4] = {
+    0xBE4BA423396CFEB8ull, 0x1CAD21F72C81017Cull, 0xDB979083E96DD4DEull, 0x1F67B3B7A4A44072ull,
+};
+
+inline u64 hash_load(const u8 *p)
+{
+    u64 x;
+    std::memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+inline void hash_blocks_scalar(u64 acc[4], u64 key[4], const u8 *p, std::size_t blocks)
+{
+    for (std::size_t b = 0; b < blocks; b++, p += 32) {
+        for (int i = 0; i < 4; i++) {
+            u64 data = hash_load(p + i*8);
+            u64 dk   = data ^ key[i];
+            acc[i ^ 1] += data;
+            acc[i]     += (dk & 0xFFFFFFFF) * (dk >> 32);
+            key[i]     += HASH_KEY_STEP;
+        }
+    }
+}
+
+#if defined(__SSE2__)
+inline void hash_blocks_sse2(u64 acc[4], u64 key[4], const u8 *p, std::size_t blocks)
+{
+    __m128i acc_lo = _mm_loadu_si128((const __m128i *) &acc[0]);
+    __m128i acc_hi = _mm_loadu_si128((const __m128i *) &acc[2]);
+    __m128i key_lo = _mm_loadu_si128((const __m128i *) &key[0]);
+    __m128i key_hi = _mm_loadu_si128((const __m128i *) &key[2]);
+    const __m128i step = _mm_set1_epi64x(HASH_KEY_STEP);
+    const auto lane = [](__m128i acc, __m128i data, __m128i key) {
+        __m128i dk = _mm_xor_si128(data, key);
+        acc = _mm_add_epi64(acc, _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_add_epi64(acc, _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32)));
+    };
+    for (std::size_t b = 0; b < blocks; b++, p += 32) {
+        acc_lo = lane(acc_lo, _mm_loadu_si128((const __m128i *) p),        key_lo);
+        acc_hi = lane(acc_hi, _mm_loadu_si128((const __m128i *) (p + 16)), key_hi);
+        key_lo = _mm_add_epi64(key_lo, step);
+        key_hi = _mm_add_epi64(key_hi, step);
+    }
+    _mm_storeu_si128((__m128i *) &acc[0], acc_lo);
+    _mm_storeu_si128((__m128i *) &acc[2], acc_hi);
+    _mm_storeu_si128((__m128i *) &key[0], key_lo);
+    _mm_storeu_si128((__m128i *) &key[2], key_hi);
+}
+#endif
+
+inline u64 hash_mix(u64 x)
+{
+    x ^= x >> 33;
+    x *= HASH_PRIME2;
+    x ^= x >> 29;
+    x *= HASH_PRIME3;
+    x ^= x >> 32;
+    return x;
+}
+
+} // namespace detail
+
+inline u64 hash64(std::span<const u8> data, u64 seed = 0, bool use_simd = true)
+{
+    using namespace detail;
+    u64 acc[4] = { HASH_PRIME1 ^ seed, HASH_PRIME2, HASH_PRIME3, HASH_PRIME1 + seed };
+    u64 key[4] = { hash_keys[0], hash_keys[1], hash_keys[2], hash_keys[3] };
+    const auto blocks = [&](const u8 *p, std::size_t n) {
+#if defined(__SSE2__)
+        if (use_simd)
+            return hash_blocks_sse2(acc, key, p, n);
+#endif
+        hash_blocks_scalar(acc, key, p, n);
+    };
+    std::size_t full = data.size() / 32;
+    blocks(data.data(), full);
+    if (std::size_t rest = data.size() % 32; rest != 0) {
+        u8 last[32] = {};
+        std::memcpy(last, data.data() + full*32, rest);
+        blocks(last, 1);
+    }
+    u64 h = data.size() * HASH_PRIME1;
+    for (int i = 0; i < 4; i++)
+        h = (h ^ hash_mix(acc[i])) * HASH_PRIME1 + HASH_PRIME3;
+    return hash_mix(h);
+}
+
+} // namespace util
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <span>
@@ -118,7 +119,19 @@ public:
         return *this;
     }
 
+    // maps a file read-only
     static std::optional<MappedFile> open(std::string_view pathname);
+    // maps size bytes of a file for reading and writing, creating it if it
+    // doesn't exist. files shorter than that are grown with zeros; longer
+    // ones are left as they are.
+    static std::optional<MappedFile> create(std::string_view pathname, std::size_t size);
+    // maps a file privately for writing: changes stay in memory, and only
+    // the pages written to are copied. the mapping is size bytes long; past
+    // the end of the file it reads as zeros.
+    static std::optional<MappedFile> open_private(std::string_view pathname, std::size_t size);
+    // writes changes back to the file now, instead of whenever the kernel
+    // wants. without wait, the writes are only started.
+    void sync(bool wait = true);
 
     u8 operator[](std::size_t index) { return ptr[index]; }
     u8 *begin() const                { return ptr; }
@@ -139,20 +152,75 @@ namespace io {
 
 inline std::optional<MappedFile> MappedFile::open(std::string_view pathname)
 {
-    int fd = ::open(pathname.data(), O_RDWR);
+    int fd = ::open(pathname.data(), O_RDONLY);
     if (fd < 0)
         return std::nullopt;
     struct stat statbuf;
     int err = fstat(fd, &statbuf);
-    if (err < 0)
+    if (err < 0) {
+        close(fd);
         return std::nullopt;
-    auto *ptr = (u8 *) mmap(nullptr, statbuf.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    // read-only and private: nothing we do can end up in the file. the
+    // pages are read in now rather than on first access
+    auto *ptr = (u8 *) mmap(nullptr, statbuf.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
     if (ptr == MAP_FAILED)
         return std::nullopt;
-    close(fd);
+    ::madvise(ptr, statbuf.st_size, MADV_WILLNEED);
     return MappedFile{ptr, static_cast<std::size_t>(statbuf.st_size), pathname};
 }
 
+inline std::optional<MappedFile> MappedFile::create(std::string_view pathname, std::size_t size)
+{
+    int fd = ::open(std::string(pathname).c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return std::nullopt;
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0 || (std::size_t(statbuf.st_size) < size && ::ftruncate(fd, size) < 0)) {
+        close(fd);
+        return std::nullopt;
+    }
+    auto *ptr = (u8 *) mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return std::nullopt;
+    return MappedFile{ptr, size, pathname};
+}
+
+inline std::optional<MappedFile> MappedFile::open_private(std::string_view pathname, std::size_t size)
+{
+    int fd = ::open(std::string(pathname).c_str(), O_RDONLY);
+    if (fd < 0)
+        return std::nullopt;
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0) {
+        close(fd);
+        return std::nullopt;
+    }
+    // zeros first, then as much of the file as fits on top of them. pages
+    // past the end of a file can't be mapped from it.
+    auto *ptr = (u8 *) mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        close(fd);
+        return std::nullopt;
+    }
+    std::size_t filelen = std::min<std::size_t>(statbuf.st_size, size);
+    if (filelen != 0 && mmap(ptr, filelen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        ::munmap(ptr, size);
+        close(fd);
+        return std::nullopt;
+    }
+    close(fd);
+    return MappedFile{ptr, size, pathname};
+}
+
+inline void MappedFile::sync(bool wait)
+{
+    if (ptr)
+        ::msync(ptr, len, wait ? MS_SYNC : MS_ASYNC);
+}
+
 inline MappedFile::~MappedFile()
 {
     if (ptr) ::munmap(ptr, len);
@@ -0,0 +1,170 @@
+#include "resampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <immintrin.h>
+#   define RESAMPLER_X86
+#endif
+
+namespace util {
+
+namespace {
+
+void dot_scalar(const float *x, const float *h0, const float *h1, std::size_t n, float &a, float &b)
+{
+    float sa[8] = {}, sb[8] = {};
+    for (std::size_t i = 0; i < n; i += 8) {
+        for (int j = 0; j < 8; j++) {
+            sa[j] += x[i+j] * h0[i+j];
+            sb[j] += x[i+j] * h1[i+j];
+        }
+    }
+    a = b = 0;
+    for (int j = 0; j < 8; j++) {
+        a += sa[j];
+        b += sb[j];
+    }
+}
+
+#ifdef RESAMPLER_X86
+float hsum(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+void dot_sse2(const float *x, const float *h0, const float *h1, std::size_t n, float &a, float &b)
+{
+    __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+    __m128 b0 = _mm_setzero_ps(), b1 = _mm_setzero_ps();
+    for (std::size_t i = 0; i < n; i += 8) {
+        __m128 x0 = _mm_loadu_ps(x + i), x1 = _mm_loadu_ps(x + i + 4);
+        a0 = _mm_add_ps(a0, _mm_mul_ps(x0, _mm_loadu_ps(h0 + i)));
+        a1 = _mm_add_ps(a1, _mm_mul_ps(x1, _mm_loadu_ps(h0 + i + 4)));
+        b0 = _mm_add_ps(b0, _mm_mul_ps(x0, _mm_loadu_ps(h1 + i)));
+        b1 = _mm_add_ps(b1, _mm_mul_ps(x1, _mm_loadu_ps(h1 + i + 4)));
+    }
+    a = hsum(_mm_add_ps(a0, a1));
+    b = hsum(_mm_add_ps(b0, b1));
+}
+
+__attribute__((target("avx2,fma")))
+void dot_avx2(const float *x, const float *h0, const float *h1, std::size_t n, float &a, float &b)
+{
+    __m256 sa = _mm256_setzero_ps(), sb = _mm256_setzero_ps();
+    for (std::size_t i = 0; i < n; i += 8) {
+        __m256 xv = _mm256_loadu_ps(x + i);
+        sa = _mm256_fmadd_ps(xv, _mm256_loadu_ps(h0 + i), sa);
+        sb = _mm256_fmadd_ps(xv, _mm256_loadu_ps(h1 + i), sb);
+    }
+    a = hsum(_mm_add_ps(_mm256_castps256_ps128(sa), _mm256_extractf128_ps(sa, 1)));
+    b = hsum(_mm_add_ps(_mm256_castps256_ps128(sb), _mm256_extractf128_ps(sb, 1)));
+}
+#endif
+
+Resampler::Simd pick_simd(Resampler::Simd wanted)
+{
+#ifdef RESAMPLER_X86
+    bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    switch (wanted) {
+    case Resampler::Simd::Auto: return has_avx2 ? Resampler::Simd::AVX2 : Resampler::Simd::SSE2;
+    case Resampler::Simd::AVX2: return has_avx2 ? Resampler::Simd::AVX2 : Resampler::Simd::SSE2;
+    default:                    return wanted;
+    }
+#else
+    return Resampler::Simd::None;
+#endif
+}
+
+Resampler::DotFn dot_function(Resampler::Simd simd)
+{
+    switch (simd) {
+#ifdef RESAMPLER_X86
+    case Resampler::Simd::SSE2: return dot_sse2;
+    case Resampler::Simd::AVX2: return dot_avx2;
+#endif
+    default: return dot_scalar;
+    }
+}
+
+} // namespace
+
+double Resampler::filter(double x, unsigned taps, double fc)
+{
+    double half = taps / 2.0;
+    if (std::abs(x) >= half)
+        return 0;
+    double t = 2 * fc * x;
+    double sinc = t == 0 ? 1.0 : std::sin(std::numbers::pi * t) / (std::numbers::pi * t);
+    double w = 0.42 + 0.5  * std::cos(std::numbers::pi * x / half)
+                    + 0.08 * std::cos(2 * std::numbers::pi * x / half);
+    return 2 * fc * sinc * w;
+}
+
+Resampler::Resampler(Options opts)
+    : ntaps((std::max(opts.taps, 8u) + 7) & ~7u), nphases(std::max(opts.phases, 1u)),
+      input_rate(opts.input_rate)
+{
+    fc   = opts.cutoff * 0.5 * std::min(1.0, opts.output_rate / opts.input_rate);
+    step = opts.input_rate / opts.output_rate;
+    simd_used = pick_simd(opts.simd);
+    dot = dot_function(simd_used);
+
+    // row p has the taps for an output sample p/phases after an input
+    // sample. each row is normalized, so that a constant input stays
+    // constant.
+    kernel.resize((nphases + 1) * ntaps);
+    const double center = ntaps / 2 - 1;
+    for (unsigned p = 0; p <= nphases; p++) {
+        double frac = double(p) / nphases;
+        double sum = 0;
+        for (unsigned k = 0; k < ntaps; k++)
+            sum += filter(k - center - frac, ntaps, fc);
+        for (unsigned k = 0; k < ntaps; k++)
+            kernel[p * ntaps + k] = filter(k - center - frac, ntaps, fc) / sum;
+    }
+    reset();
+}
+
+void Resampler::reset()
+{
+    // the filter is centered on the first input sample
+    buf.assign(ntaps / 2 - 1, 0.0f);
+    pos = 0;
+}
+
+void Resampler::process(std::span<const float> in, std::vector<float> &out)
+{
+    buf.insert(buf.end(), in.begin(), in.end());
+    std::size_t avail = buf.size();
+    for (;;) {
+        std::size_t i = pos;
+        if (i + ntaps > avail)
+            break;
+        double p = (pos - i) * nphases;
+        unsigned phase = p;
+        float frac = p - phase;
+        float a, b;
+        dot(&buf[i], &kernel[phase * ntaps], &kernel[(phase + 1) * ntaps], ntaps, a, b);
+        out.push_back(a + (b - a) * frac);
+        pos += step;
+    }
+    std::size_t used = std::min<std::size_t>(pos, avail);
+    buf.erase(buf.begin(), buf.begin() + used);
+    pos -= used;
+}
+
+void Resampler::process(std::span<const i16> in, std::vector<i16> &out)
+{
+    tmp_in.assign(in.begin(), in.end());
+    tmp_out.clear();
+    process(tmp_in, tmp_out);
+    for (float s : tmp_out)
+        out.push_back(std::clamp(std::lround(s), -32768l, 32767l));
+}
+
+} // namespace util
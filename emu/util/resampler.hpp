@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+ * A polyphase FIR resampler for a stream of mono samples. Works for any pair
+ * of rates (including big ratios, like from the CPU clock to 48 kHz) and the
+ * ratio can be changed on the fly.
+ * The filter is a Blackman-windowed sinc; a table holds its taps for a
+ * number of fractional positions (the phases) and each output sample is
+ * computed from the two phases around its exact position, interpolating
+ * between them. The dot products are done with AVX2 or SSE2 when available.
+ * The output is delayed by half the filter length, but otherwise starts at
+ * the same time as the input: the first output sample is at the time of the
+ * first input sample.
+ */
+
+#include <span>
+#include <vector>
+#include "common.hpp"
+
+namespace util {
+
+class Resampler {
+public:
+    enum class Simd { Auto, None, SSE2, AVX2 };
+
+    struct Options {
+        double input_rate;
+        double output_rate;
+        unsigned taps   = 32;   // rounded up to a multiple of 8
+        unsigned phases = 256;
+        double cutoff   = 0.9;  // as a fraction of the lower rate's Nyquist frequency
+        Simd simd       = Simd::Auto;
+    };
+
+    using DotFn = void (*)(const float *x, const float *h0, const float *h1, std::size_t n, float &a, float &b);
+
+private:
+    unsigned ntaps;
+    unsigned nphases;
+    std::vector<float> kernel;  // (phases + 1) rows of taps
+    std::vector<float> buf;     // input that hasn't been fully used yet
+    std::vector<float> tmp_in, tmp_out;
+    double input_rate;
+    double fc;                  // cutoff, in cycles per input sample
+    double step;                // input samples per output sample
+    double pos;                 // position of the next output sample inside buf
+    DotFn dot;
+    Simd simd_used;
+
+public:
+    explicit Resampler(Options opts);
+
+    void set_output_rate(double rate) { step = input_rate / rate; }
+    void reset();
+    void process(std::span<const float> in, std::vector<float> &out);
+    void process(std::span<const i16> in, std::vector<i16> &out);
+
+    unsigned taps() const   { return ntaps; }
+    unsigned phases() const { return nphases; }
+    Simd simd() const       { return simd_used; }
+    double cutoff() const   { return fc; }
+    // the value of the filter at distance x (in input samples), before normalization
+    static double filter(double x, unsigned taps, double fc);
+};
+
+} // namespace util
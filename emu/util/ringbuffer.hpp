@@ -0,0 +1,79 @@
+#pragma once
+
+/*
+ * A lock-free ring buffer for exactly one producer thread and one consumer
+ * thread. The producer only ever writes the tail and the consumer the head,
+ * so each side needs a single atomic load of the other side's index; the
+ * indexes keep counting up and are wrapped only when accessing the data,
+ * which is why the capacity must be a power of two.
+ * Each index is kept on its own cache line, so that the two threads don't
+ * keep stealing it from each other.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <span>
+#include "common.hpp"
+
+namespace util {
+
+template <typename T>
+class RingBuffer {
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    std::unique_ptr<T[]> buf;
+    std::size_t cap = 0;
+    std::size_t mask = 0;
+    alignas(CACHE_LINE) std::atomic<std::size_t> head = 0;  // written by the consumer
+    alignas(CACHE_LINE) std::atomic<std::size_t> tail = 0;  // written by the producer
+
+public:
+    RingBuffer() = default;
+    explicit RingBuffer(std::size_t capacity) { resize(capacity); }
+
+    // not thread-safe: neither side may be using the buffer.
+    void resize(std::size_t capacity)
+    {
+        cap  = std::bit_ceil(capacity);
+        mask = cap - 1;
+        buf  = std::make_unique<T[]>(cap);
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+    std::size_t capacity() const { return cap; }
+
+    // these are only exact when called from either side.
+    std::size_t size() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    // producer side. returns how many items were written.
+    std::size_t push(std::span<const T> data)
+    {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        std::size_t n = std::min(data.size(), cap - (t - head.load(std::memory_order_acquire)));
+        std::size_t first = std::min(n, cap - (t & mask));
+        std::copy(data.begin(), data.begin() + first, &buf[t & mask]);
+        std::copy(data.begin() + first, data.begin() + n, &buf[0]);
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // consumer side. returns how many items were read.
+    std::size_t pop(std::span<T> out)
+    {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        std::size_t n = std::min(out.size(), tail.load(std::memory_order_acquire) - h);
+        std::size_t first = std::min(n, cap - (h & mask));
+        std::copy(&buf[h & mask], &buf[h & mask] + first, out.begin());
+        std::copy(&buf[0], &buf[0] + (n - first), out.begin() + first);
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+};
+
+} // namespace util
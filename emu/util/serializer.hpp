@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+ * A serializer for machine state. Each component implements a single
+ * serialize() function which visits all of its state; the same function is
+ * then used for saving, loading and computing the size of a state. Example:
+ *
+ * void Component::serialize(util::Serializer &s)
+ * {
+ *     s(some_register);
+ *     s(some_array);
+ * }
+ *
+ * Only trivially copyable types can be passed. Saving and loading never
+ * allocate: the buffer must be provided by the caller.
+ * Fields can be given a name; passing a vector of Fields when computing the
+ * size records where each field lives inside a state, which is useful to
+ * tell what differs between two states.
+ */
+
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "common.hpp"
+
+namespace util {
+
+class Serializer {
+public:
+    enum class Mode { Size, Save, Load };
+
+    struct Field {
+        std::string_view name;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+private:
+    Mode m;
+    u8 *buf = nullptr;
+    std::size_t len = 0;
+    std::size_t pos = 0;
+    bool overflow = false;
+    std::vector<Field> *fields = nullptr;
+
+public:
+    explicit Serializer()                       : m(Mode::Size) { }
+    explicit Serializer(std::vector<Field> &layout) : m(Mode::Size), fields(&layout) { }
+    explicit Serializer(std::span<u8> out)      : m(Mode::Save), buf(out.data()), len(out.size()) { }
+    explicit Serializer(std::span<const u8> in) : m(Mode::Load), buf(const_cast<u8 *>(in.data())), len(in.size()) { }
+
+    void bytes(void *data, std::size_t size, std::string_view name = "")
+    {
+        if (fields)
+            fields->push_back({ .name = name, .offset = pos, .size = size });
+        if (m != Mode::Size && pos + size > len) {
+            overflow = true;
+            return;
+        }
+        switch (m) {
+        case Mode::Size: break;
+        case Mode::Save: std::memcpy(buf + pos, data, size); break;
+        case Mode::Load: std::memcpy(data, buf + pos, size); break;
+        }
+        pos += size;
+    }
+
+    template <typename T>
+    void operator()(T &value, std::string_view name = "")
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be serialized");
+        bytes(&value, sizeof(T), name);
+    }
+
+    Mode mode() const        { return m; }
+    bool loading() const     { return m == Mode::Load; }
+    std::size_t size() const { return pos; }
+    bool ok() const          { return !overflow; }
+};
+
+} // namespace util
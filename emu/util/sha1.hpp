@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <span>
+#include "common.hpp"
+
+namespace util {
+
+// SHA-1, as found in ROM databases (No-Intro, etc.). call update() any
+// number of times, then finish() once.
+class SHA1 {
+    std::array<u32, 5> h = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    std::array<u8, 64> block;
+    std::size_t used = 0;
+    u64 length = 0;
+
+    void process(const u8 *p)
+    {
+        std::array<u32, 80> w;
+        for (int i = 0; i < 16; i++)
+            w[i] = u32(p[i*4]) << 24 | u32(p[i*4+1]) << 16 | u32(p[i*4+2]) << 8 | u32(p[i*4+3]);
+        for (int i = 16; i < 80; i++)
+            w[i] = std::rotl(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+        u32 a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            u32 f, k;
+            if      (i < 20) { f = (b & c) | (~b & d);          k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+            u32 t = std::rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = std::rotl(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+public:
+    void update(std::span<const u8> data)
+    {
+        const u8 *p = data.data();
+        std::size_t n = data.size();
+        length += n;
+        if (used > 0) {
+            std::size_t k = std::min(n, block.size() - used);
+            std::memcpy(block.data() + used, p, k);
+            used += k; p += k; n -= k;
+            if (used < block.size())
+                return;
+            process(block.data());
+            used = 0;
+        }
+        for ( ; n >= 64; p += 64, n -= 64)
+            process(p);
+        std::memcpy(block.data(), p, n);
+        used = n;
+    }
+
+    std::array<u8, 20> finish()
+    {
+        u64 bits = length * 8;
+        std::array<u8, 72> pad = { 0x80 };
+        std::size_t padlen = used < 56 ? 56 - used : 120 - used;
+        for (int i = 0; i < 8; i++)
+            pad[padlen + i] = bits >> (56 - i * 8);
+        update(std::span{pad.data(), padlen + 8});
+        std::array<u8, 20> digest;
+        for (int i = 0; i < 20; i++)
+            digest[i] = h[i/4] >> (24 - i % 4 * 8);
+        return digest;
+    }
+};
+
+inline std::array<u8, 20> sha1(std::span<const u8> data)
+{
+    SHA1 s;
+    s.update(data);
+    return s.finish();
+}
+
+} // namespace util
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cerrno>
+#include <ctime>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "common.hpp"
+
+#if defined(PLATFORM_LINUX)
+#   include <fcntl.h>
+#   include <linux/futex.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#else
+#   warning "platform not supported"
+#endif
+
+namespace io {
+
+// a POSIX shared memory object, mapped into memory. the one who creates it
+// also removes it.
+class SharedMemory {
+    u8 *ptr = nullptr;
+    std::size_t len = 0;
+    std::string name;
+    bool owner = false;
+
+    SharedMemory(u8 *p, std::size_t l, std::string_view n, bool o) : ptr(p), len(l), name(n), owner(o) { }
+
+public:
+    ~SharedMemory();
+
+    SharedMemory(const SharedMemory &) = delete;
+    SharedMemory & operator=(const SharedMemory &) = delete;
+    SharedMemory(SharedMemory &&m) noexcept { operator=(std::move(m)); }
+    SharedMemory & operator=(SharedMemory &&m) noexcept
+    {
+        std::swap(ptr, m.ptr);
+        std::swap(len, m.len);
+        std::swap(name, m.name);
+        std::swap(owner, m.owner);
+        return *this;
+    }
+
+    // names look like "/name".
+    static std::optional<SharedMemory> create(std::string_view name, std::size_t size);
+    static std::optional<SharedMemory> open(std::string_view name);
+
+    u8 *data() const         { return ptr; }
+    std::size_t size() const { return len; }
+};
+
+// waits until the value at addr isn't expected anymore, or until the
+// timeout (in nanoseconds) expires. works across processes.
+inline void futex_wait(u32 *addr, u32 expected, long timeout_ns);
+inline void futex_wake_all(u32 *addr);
+
+#ifdef PLATFORM_LINUX
+
+inline std::optional<SharedMemory> SharedMemory::create(std::string_view name, std::size_t size)
+{
+    std::string n{name};
+    int fd = ::shm_open(n.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+        return std::nullopt;
+    if (::ftruncate(fd, size) < 0) {
+        ::close(fd);
+        ::shm_unlink(n.c_str());
+        return std::nullopt;
+    }
+    auto *ptr = (u8 *) ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+        ::shm_unlink(n.c_str());
+        return std::nullopt;
+    }
+    return SharedMemory{ptr, size, name, true};
+}
+
+inline std::optional<SharedMemory> SharedMemory::open(std::string_view name)
+{
+    std::string n{name};
+    int fd = ::shm_open(n.c_str(), O_RDWR, 0);
+    if (fd < 0)
+        return std::nullopt;
+    struct stat statbuf;
+    if (::fstat(fd, &statbuf) < 0) {
+        ::close(fd);
+        return std::nullopt;
+    }
+    auto *ptr = (u8 *) ::mmap(nullptr, statbuf.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED)
+        return std::nullopt;
+    return SharedMemory{ptr, std::size_t(statbuf.st_size), name, false};
+}
+
+inline SharedMemory::~SharedMemory()
+{
+    if (!ptr)
+        return;
+    ::munmap(ptr, len);
+    if (owner)
+        ::shm_unlink(name.c_str());
+}
+
+inline void futex_wait(u32 *addr, u32 expected, long timeout_ns)
+{
+    timespec ts = { .tv_sec = timeout_ns / 1'000'000'000, .tv_nsec = timeout_ns % 1'000'000'000 };
+    ::syscall(SYS_futex, addr, FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+inline void futex_wake_all(u32 *addr)
+{
+    ::syscall(SYS_futex, addr, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+#endif
+
+} // namespace io
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include "common.hpp"
+
+#if defined(PLATFORM_LINUX)
+#   include <arpa/inet.h>
+#   include <fcntl.h>
+#   include <netdb.h>
+#   include <netinet/in.h>
+#   include <sys/socket.h>
+#   include <unistd.h>
+#else
+#   warning "platform not supported"
+#endif
+
+namespace io {
+
+// an IPv4 address and port.
+struct Address {
+    sockaddr_in addr = {};
+
+    static std::optional<Address> resolve(std::string_view host, u16 port);
+    bool operator==(const Address &a) const
+    {
+        return addr.sin_addr.s_addr == a.addr.sin_addr.s_addr && addr.sin_port == a.addr.sin_port;
+    }
+    u16 port() const { return ntohs(addr.sin_port); }
+};
+
+// a non-blocking UDP socket.
+class UdpSocket {
+    int fd = -1;
+
+    explicit UdpSocket(int f) : fd(f) { }
+
+public:
+    ~UdpSocket() { if (fd >= 0) ::close(fd); }
+
+    UdpSocket(const UdpSocket &) = delete;
+    UdpSocket & operator=(const UdpSocket &) = delete;
+    UdpSocket(UdpSocket &&s) noexcept { operator=(std::move(s)); }
+    UdpSocket & operator=(UdpSocket &&s) noexcept
+    {
+        std::swap(fd, s.fd);
+        return *this;
+    }
+
+    // binds to the given port on all interfaces. port 0 picks any free port.
+    static std::optional<UdpSocket> open(u16 port);
+
+    bool send(const Address &to, std::span<const u8> data);
+    // returns the size of the packet received, or nothing if there are no packets.
+    std::optional<std::size_t> recv(std::span<u8> buf, Address *from = nullptr);
+    std::optional<u16> local_port() const;
+};
+
+#ifdef PLATFORM_LINUX
+
+inline std::optional<Address> Address::resolve(std::string_view host, u16 port)
+{
+    addrinfo hints = {};
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *res = nullptr;
+    if (getaddrinfo(std::string(host).c_str(), nullptr, &hints, &res) != 0 || !res)
+        return std::nullopt;
+    Address a;
+    std::memcpy(&a.addr, res->ai_addr, sizeof(a.addr));
+    a.addr.sin_port = htons(port);
+    freeaddrinfo(res);
+    return a;
+}
+
+inline std::optional<UdpSocket> UdpSocket::open(u16 port)
+{
+    int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return std::nullopt;
+    UdpSocket sock{fd};
+    sockaddr_in addr = {};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(port);
+    if (::bind(fd, (sockaddr *) &addr, sizeof(addr)) < 0)
+        return std::nullopt;
+    if (::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+        return std::nullopt;
+    return sock;
+}
+
+inline bool UdpSocket::send(const Address &to, std::span<const u8> data)
+{
+    return ::sendto(fd, data.data(), data.size(), 0, (const sockaddr *) &to.addr, sizeof(to.addr)) == ssize_t(data.size());
+}
+
+inline std::optional<std::size_t> UdpSocket::recv(std::span<u8> buf, Address *from)
+{
+    sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    ssize_t n = ::recvfrom(fd, buf.data(), buf.size(), 0, (sockaddr *) &addr, &len);
+    if (n < 0)
+        return std::nullopt;
+    if (from)
+        from->addr = addr;
+    return std::size_t(n);
+}
+
+inline std::optional<u16> UdpSocket::local_port() const
+{
+    sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    if (::getsockname(fd, (sockaddr *) &addr, &len) < 0)
+        return std::nullopt;
+    return ntohs(addr.sin_port);
+}
+
+#endif
+
+} // namespace io
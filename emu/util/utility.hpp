@@ -1,8 +1,10 @@
 #pragma once
 
 #include <cstring>
+#include <ctime>
 #include <functional>
 #include <optional>
+#include <sys/resource.h>
 
 namespace util {
 
@@ -40,6 +42,22 @@ inline std::string_view system_error_string()
     return std::strerror(errno);
 }
 
+// returns the CPU time used by the calling thread, in seconds.
+inline double thread_cpu_time()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// returns the most memory the process has had resident, in KiB.
+inline long peak_rss()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
 template <typename T>
 T ceil_div(T x, T y)
 {
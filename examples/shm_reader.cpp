@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+#include <fmt/core.h>
+#include <emu/shmexport.hpp>
+#include <emu/util/shm.hpp>
+#include <emu/util/string.hpp>
+
+/*
+ * A small example of a tool reading from the emulator's shared memory (see
+ * emu/shmexport.hpp). Start the emulator with --shm /yanesemu, then run:
+ *     shm_reader /yanesemu [frames]
+ * It follows the frames as they're published, reading them in place, and
+ * prints how long each one took to arrive.
+ */
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fmt::print(stderr, "usage: {} NAME [FRAMES]\n", argv[0]);
+        return 1;
+    }
+    unsigned max_frames = argc > 2 ? str::to_num(argv[2]).value_or(600) : 600;
+    auto mem = io::SharedMemory::open(argv[1]);
+    if (!mem) {
+        fmt::print(stderr, "couldn't open {}\n", argv[1]);
+        return 1;
+    }
+    u8 *base = mem.value().data();
+    auto *h = shm::header(base);
+    if (std::memcmp(h->magic, shm::MAGIC, sizeof(shm::MAGIC)) != 0 || h->version != shm::VERSION) {
+        fmt::print(stderr, "{} isn't from a compatible emulator\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<u64> latencies;
+    u64 next = std::atomic_ref(h->latest).load(std::memory_order_acquire);
+    unsigned torn = 0, missed = 0;
+    while (latencies.size() < max_frames && std::atomic_ref(h->alive).load(std::memory_order_acquire)) {
+        u32 bell = std::atomic_ref(h->doorbell).load(std::memory_order_seq_cst);
+        u64 latest = std::atomic_ref(h->latest).load(std::memory_order_acquire);
+        if (latest <= next) {
+            std::atomic_ref(h->waiters).fetch_add(1, std::memory_order_seq_cst);
+            io::futex_wait(&h->doorbell, bell, 100'000'000);
+            std::atomic_ref(h->waiters).fetch_sub(1, std::memory_order_seq_cst);
+            continue;
+        }
+        // if we fell too far behind, skip to the oldest frame still there
+        if (latest - next > h->slots) {
+            missed += latest - next - h->slots;
+            next = latest - h->slots;
+        }
+        for ( ; next < latest; next++) {
+            auto *s = shm::slot(base, next);
+            std::atomic_ref seq{s->seq};
+            u64 before = seq.load(std::memory_order_acquire);
+            // read what we need straight from the shared memory
+            u64 stamp = s->timestamp, frame = s->frame;
+            u8 keys = s->keys[0];
+            unsigned ram_sum = 0;
+            for (u32 i = 0; i < h->ram_size; i++)
+                ram_sum += s->ram[i];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if ((before & 1) || seq.load(std::memory_order_relaxed) != before || frame != next) {
+                torn++;
+                continue;
+            }
+            latencies.push_back(shm::now_ns() - stamp);
+            if (frame % 60 == 0)
+                fmt::print("frame {}: keys {:08b}, RAM sum {}\n", frame, keys, ram_sum);
+        }
+    }
+    if (latencies.empty()) {
+        fmt::print("no frames received\n");
+        return 0;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    u64 sum = 0;
+    for (auto l : latencies)
+        sum += l;
+    fmt::print("{} frames, {} torn, {} missed. latency: min {:.1f} us, median {:.1f} us, "
+               "99th percentile {:.1f} us, max {:.1f} us, mean {:.1f} us\n",
+               latencies.size(), torn, missed, latencies.front() / 1e3, latencies[latencies.size() / 2] / 1e3,
+               latencies[latencies.size() * 99 / 100] / 1e3, latencies.back() / 1e3, sum / 1e3 / latencies.size());
+}
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+#include <emu/core/cartridge.hpp>
+#include <emu/core/gamedb.hpp>
+#include <emu/util/crc32.hpp>
+#include <emu/util/io.hpp>
+#include <catch2/catch.hpp>
+
+using namespace core;
+
+namespace fs = std::filesystem;
+
+// Gilligan's Island: UxROM, with vertical mirroring
+static constexpr u32 LISTED_CRC = 0x55773880;
+
+// sets the last 4 bytes of data so that its CRC32 is target. CRC32 is
+// linear: the last 4 table lookups of the checksum are found going
+// backwards from target, then the bytes that lead to them going forwards.
+static void force_crc(std::span<u8> data, u32 target)
+{
+    const auto &t = util::detail::crc32_tables[0];
+    std::array<u8, 4> index;
+    u32 r = ~target;
+    for (int k = 3; k >= 0; k--) {
+        auto j = std::find_if(t.begin(), t.end(), [&](u32 x) { return x >> 24 == r >> 24; }) - t.begin();
+        index[k] = j;
+        r = (r ^ t[j]) << 8;
+    }
+    auto tail = data.last(4);
+    u32 c = ~util::crc32(data.first(data.size() - 4));
+    for (int k = 0; k < 4; k++) {
+        tail[k] = (c ^ index[k]) & 0xFF;
+        c = (c >> 8) ^ t[index[k]];
+    }
+}
+
+struct CartridgeTest {
+    fs::path path = fs::temp_directory_path() / "yanesemu_cartridge_test.nes";
+    std::optional<io::MappedFile> romfile;
+
+    ~CartridgeTest()
+    {
+        std::error_code ec;
+        fs::remove(path, ec);
+    }
+
+    // one 16 KiB bank of PRG ROM and one 8 KiB bank of CHR ROM, mapper 2,
+    // horizontal mirroring, whose PRG and CHR ROM have the given CRC32
+    std::optional<Cartridge::Data> parse(u32 crc)
+    {
+        std::vector<u8> rom(16 + 16 * 1024 + 8 * 1024, 0xEA);
+        const u8 header[] = { 'N', 'E', 'S', 0x1A, 1, 1, 0x20, 0 };
+        std::copy(std::begin(header), std::end(header), rom.begin());
+        std::fill(rom.begin() + 8, rom.begin() + 16, 0);
+        force_crc(std::span{rom}.subspan(16), crc);
+        auto file = io::File::open(path.string(), io::Access::Write);
+        REQUIRE(file);
+        REQUIRE(std::fwrite(rom.data(), 1, rom.size(), file.value().data()) == rom.size());
+        file.reset();
+        romfile = io::MappedFile::open(path.string());
+        REQUIRE(romfile);
+        return parse_cartridge(romfile.value());
+    }
+
+    void listed();
+    void not_listed();
+};
+
+METHOD_AS_TEST_CASE(CartridgeTest::listed,     "A CRC in the game database overrides the header");
+METHOD_AS_TEST_CASE(CartridgeTest::not_listed, "A CRC not in the game database keeps the header");
+
+void CartridgeTest::listed()
+{
+    REQUIRE(find_header_fix(LISTED_CRC));
+    auto cart = parse(LISTED_CRC);
+    REQUIRE(cart);
+    REQUIRE(cart->crc == LISTED_CRC);
+    REQUIRE(cart->fixed_header);
+    REQUIRE(cart->mapper == 2);
+    REQUIRE(cart->mirroring == Mirroring::Vertical);
+}
+
+void CartridgeTest::not_listed()
+{
+    REQUIRE(!find_header_fix(LISTED_CRC + 1));
+    auto cart = parse(LISTED_CRC + 1);
+    REQUIRE(cart);
+    REQUIRE(cart->crc == LISTED_CRC + 1);
+    REQUIRE(!cart->fixed_header);
+    REQUIRE(cart->mapper == 2);
+    REQUIRE(cart->mirroring == Mirroring::Horizontal);
+}
@@ -1,4 +1,5 @@
 #include <emu/core/cpu.hpp>
+#include <emu/core/apu.hpp>
 #include <emu/core/bus.hpp>
 #include <emu/core/controller.hpp>
 #include <catch2/catch.hpp>
@@ -7,8 +8,9 @@ using namespace core;
 
 struct CPUTest {
     Bus<CPUBUS_SIZE> bus;
-    ControllerPort port;
-    CPU cpu{&bus, &port};
+    ControllerPort port1, port2;
+    CPU cpu{&bus, &port1, &port2, &apu};
+    APU apu{&bus, &cpu};
     std::array<u8, CPUBUS_SIZE> mem;
 
     CPUTest()
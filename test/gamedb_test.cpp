@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <type_traits>
+#include <emu/core/gamedb.hpp>
+#include <catch2/catch.hpp>
+
+using core::HeaderFix;
+using core::detail::make_table;
+
+// spread-out keys, as CRCs are
+template <std::size_t N>
+static constexpr std::array<HeaderFix, N> make_keys(u32 seed)
+{
+    std::array<HeaderFix, N> keys = {};
+    for (std::size_t i = 0; i < N; i++)
+        keys[i] = { .crc = core::detail::mix(seed + i * 0x9E3779B9u), .mapper = u16(i) };
+    return keys;
+}
+
+// true if the table for keys can be built at compile time
+template <auto &keys>
+concept buildable = requires {
+    typename std::integral_constant<u16, make_table<std::size(keys)>(keys).slots[0]>;
+};
+
+static constexpr std::initializer_list<HeaderFix> one = { { .crc = 0xDEADBEEF } };
+static constexpr std::initializer_list<HeaderFix> few = {
+    { .crc = 0x00000000 }, { .crc = 0x00000001 }, { .crc = 0x80000000 },
+    { .crc = 0xFFFFFFFF }, { .crc = 0x12345678 },
+};
+static constexpr auto many = make_keys<1000>(1);
+static constexpr std::initializer_list<HeaderFix> duplicate = {
+    { .crc = 0x12345678 }, { .crc = 0xCAFEBABE }, { .crc = 0x12345678 },
+};
+
+static_assert(buildable<one> && buildable<few> && buildable<many>);
+static_assert(!buildable<duplicate>, "a duplicate CRC must not compile");
+
+template <std::size_t N>
+static void check_table(std::span<const HeaderFix> keys)
+{
+    const auto table = make_table<N>(keys);
+    for (const auto &key : keys) {
+        const auto *fix = table.find(keys, key.crc);
+        INFO("crc: " << key.crc);
+        REQUIRE(fix == &key);
+    }
+    // keys next to the real ones, and a run of others
+    for (const auto &key : keys) {
+        for (u32 crc : { key.crc + 1, key.crc - 1, ~key.crc, key.crc ^ 0x80000000 }) {
+            if (std::find_if(keys.begin(), keys.end(), [&](const auto &k) { return k.crc == crc; }) != keys.end())
+                continue;
+            INFO("crc: " << crc);
+            REQUIRE(table.find(keys, crc) == nullptr);
+        }
+    }
+    auto absent = make_keys<5000>(2);
+    for (const auto &a : absent)
+        if (std::find_if(keys.begin(), keys.end(), [&](const auto &k) { return k.crc == a.crc; }) == keys.end())
+            REQUIRE(table.find(keys, a.crc) == nullptr);
+}
+
+TEST_CASE("Header fix table finds every key", "[gamedb]")
+{
+    check_table<one.size()>(one);
+    check_table<few.size()>(few);
+    check_table<many.size()>(many);
+}
+
+TEST_CASE("Header fix table is built at compile time", "[gamedb]")
+{
+    static constexpr auto table = make_table<few.size()>(few);
+    static_assert(table.find(few, 0x12345678) == few.begin() + 4);
+    static_assert(table.find(few, 0x12345679) == nullptr);
+}
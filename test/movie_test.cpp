@@ -0,0 +1,120 @@
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <vector>
+#include <emu/core/cartridge.hpp>
+#include <emu/core/emulator.hpp>
+#include <emu/util/io.hpp>
+#include <catch2/catch.hpp>
+
+using namespace core;
+
+namespace fs = std::filesystem;
+
+// an NROM cartridge whose main loop counts as fast as it can, with an NMI
+// handler that keeps the count, so that the state depends on exactly when
+// a reset happens.
+static std::vector<u8> make_rom()
+{
+    std::vector<u8> rom(16 + 16 * 1024 + 8 * 1024);
+    const u8 header[] = { 'N', 'E', 'S', 0x1A, 1, 1 };
+    std::copy(std::begin(header), std::end(header), rom.begin());
+    const u8 code[] = {
+        0x78,               // 8000 sei
+        0xD8,               // 8001 cld
+        0xA2, 0xFF,         // 8002 ldx #$FF
+        0x9A,               // 8004 txs
+        0xA9, 0x80,         // 8005 lda #$80
+        0x8D, 0x00, 0x20,   // 8007 sta $2000
+        0xE6, 0x00,         // 800A inc $00
+        0xD0, 0xFC,         // 800C bne $800A
+        0xE6, 0x01,         // 800E inc $01
+        0x4C, 0x0A, 0x80,   // 8010 jmp $800A
+        0xE6, 0x02,         // 8013 inc $02 (NMI)
+        0xA5, 0x00,         // 8015 lda $00
+        0x85, 0x03,         // 8017 sta $03
+        0x40,               // 8019 rti
+    };
+    std::copy(std::begin(code), std::end(code), rom.begin() + 16);
+    const u8 vectors[] = { 0x13, 0x80, 0x00, 0x80, 0x13, 0x80 };
+    std::copy(std::begin(vectors), std::end(vectors), rom.begin() + 16 + 0x3FFA);
+    return rom;
+}
+
+struct MovieTest {
+    fs::path rom_path   = fs::temp_directory_path() / "yanesemu_movie_test.nes";
+    fs::path movie_path = fs::temp_directory_path() / "yanesemu_movie_test.ynm";
+    std::optional<io::MappedFile> romfile;
+    std::optional<Cartridge::Data> cart;
+
+    MovieTest()
+    {
+        auto rom = make_rom();
+        auto file = io::File::open(rom_path.string(), io::Access::Write);
+        REQUIRE(file);
+        REQUIRE(std::fwrite(rom.data(), 1, rom.size(), file.value().data()) == rom.size());
+        file.reset();
+        romfile = io::MappedFile::open(rom_path.string());
+        REQUIRE(romfile);
+        cart = parse_cartridge(romfile.value());
+        REQUIRE(cart);
+    }
+
+    ~MovieTest()
+    {
+        std::error_code ec;
+        fs::remove(rom_path, ec);
+        fs::remove(movie_path, ec);
+    }
+
+    std::unique_ptr<Emulator> make_emulator()
+    {
+        auto emu = std::make_unique<Emulator>();
+        REQUIRE(emu->insert_rom(cart.value()));
+        emu->set_headless(true);
+        return emu;
+    }
+
+    static std::vector<u8> state(Emulator &emu)
+    {
+        std::vector<u8> buf(emu.state_size());
+        emu.save_state(buf);
+        return buf;
+    }
+
+    void reset_mid_frame();
+};
+
+METHOD_AS_TEST_CASE(MovieTest::reset_mid_frame, "A reset in the middle of a frame plays back the same");
+
+void MovieTest::reset_mid_frame()
+{
+    constexpr int FRAMES = 120;
+
+    auto rec = make_emulator();
+    REQUIRE(rec->record_movie(movie_path.string()));
+    rec->power();
+    for (int i = 0; i < FRAMES; i++) {
+        if (i == 50) {
+            // well into the frame, as the debugger would do it
+            for (int j = 0; j < 1000; j++)
+                rec->step();
+            rec->power(/* reset = */ true);
+        }
+        rec->run_frame();
+    }
+    rec->stop_movie();
+    auto recorded = state(*rec);
+
+    auto play = make_emulator();
+    REQUIRE(play->play_movie(movie_path.string()));
+    play->power();
+    for (int i = 0; i < FRAMES && !play->movie_finished(); i++)
+        play->run_frame();
+    REQUIRE(!play->movie_finished());
+    REQUIRE(state(*play) == recorded);
+    // the movie had the input of the frame after the last one too
+    play->run_frame();
+    REQUIRE(play->movie_finished());
+}
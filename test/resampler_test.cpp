@@ -0,0 +1,61 @@
+#include <cmath>
+#include <numbers>
+#include <vector>
+#include <emu/util/resampler.hpp>
+#include <catch2/catch.hpp>
+
+using util::Resampler;
+
+// resamples the same signal with the resampler (fed in chunks of different
+// sizes) and with a direct double-precision evaluation of the filter, then
+// returns the signal-to-noise ratio of the first against the second, in dB.
+static double resampler_snr(Resampler::Options opts, double freq1, double freq2)
+{
+    const std::size_t len = std::size_t(opts.input_rate / 10);
+    std::vector<float> in(len);
+    for (std::size_t m = 0; m < len; m++)
+        in[m] = 0.5 * std::sin(2 * std::numbers::pi * freq1 * m / opts.input_rate)
+              + 0.3 * std::sin(2 * std::numbers::pi * freq2 * m / opts.input_rate + 1.0);
+
+    Resampler rs{opts};
+    std::vector<float> out;
+    for (std::size_t i = 0, chunk = 1; i < len; i += chunk, chunk = chunk * 3 % 1009 + 1)
+        rs.process(std::span{in}.subspan(i, std::min(chunk, len - i)), out);
+
+    const double step = opts.input_rate / opts.output_rate;
+    const double half = rs.taps() / 2.0;
+    double signal = 0, noise = 0;
+    for (std::size_t n = 0; n < out.size(); n++) {
+        double t = n * step;
+        double sum = 0, norm = 0;
+        for (long m = std::ceil(t - half); m < t + half; m++) {
+            double h = Resampler::filter(m - t, rs.taps(), rs.cutoff());
+            norm += h;
+            if (m >= 0 && m < long(len))
+                sum += in[m] * h;
+        }
+        double ref = sum / norm;
+        signal += ref * ref;
+        noise  += (out[n] - ref) * (out[n] - ref);
+    }
+    REQUIRE(out.size() > (len - rs.taps()) / step - 1);
+    return 10 * std::log10(signal / noise);
+}
+
+TEST_CASE("Resampler 48000 -> 44100", "[resampler]")
+{
+    for (auto simd : { Resampler::Simd::None, Resampler::Simd::SSE2, Resampler::Simd::AVX2 }) {
+        double snr = resampler_snr({ .input_rate = 48000, .output_rate = 44100, .taps = 32, .simd = simd }, 440, 15000);
+        INFO("simd: " << int(simd) << ", snr: " << snr);
+        REQUIRE(snr > 100);
+    }
+}
+
+TEST_CASE("Resampler CPU clock -> 48000", "[resampler]")
+{
+    for (auto simd : { Resampler::Simd::None, Resampler::Simd::SSE2, Resampler::Simd::AVX2 }) {
+        double snr = resampler_snr({ .input_rate = 1789773, .output_rate = 48000, .taps = 384, .simd = simd }, 1000, 12000);
+        INFO("simd: " << int(simd) << ", snr: " << snr);
+        REQUIRE(snr > 100);
+    }
+}
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <vector>
+#include <emu/core/rewind.hpp>
+#include <catch2/catch.hpp>
+
+using core::Rewinder;
+
+static constexpr std::size_t STATE_SIZE = 4096;
+
+// the state saved at frame i: mostly the same from frame to frame, like
+// the real one, with a frame counter, a few scattered bytes that change
+// and, once in a while, a whole block that does.
+static std::vector<u8> make_state(unsigned i)
+{
+    std::vector<u8> s(STATE_SIZE);
+    for (std::size_t j = 0; j < s.size(); j++)
+        s[j] = j * 7 + (j >> 8);
+    for (int k = 0; k < 4; k++)
+        s[k] = i >> (k * 8);
+    for (unsigned k = 0; k < 8; k++)
+        s[(i * 131 + k * 509) % s.size()] = i + k;
+    if (i % 50 == 0) {
+        std::size_t start = (i * 7) % (s.size() - 512);
+        for (std::size_t j = 0; j < 512; j++)
+            s[start + j] = (i ^ j) * 0x9D;
+    }
+    return s;
+}
+
+static void push(Rewinder &rw, unsigned i)
+{
+    auto s = make_state(i);
+    auto next = rw.next_state();
+    std::copy(s.begin(), s.end(), next.begin());
+    rw.push();
+}
+
+// steps back one frame at a time from the latest one, which is frame
+// last, checking that every snapshot comes back byte-identical.
+static void check_all(Rewinder &rw, unsigned last)
+{
+    auto latest = rw.rewind(0);
+    REQUIRE(latest);
+    REQUIRE(std::ranges::equal(latest.value(), make_state(last)));
+    for (unsigned frame = last; rw.size() > 1; ) {
+        auto s = rw.rewind(1);
+        REQUIRE(s);
+        frame--;
+        INFO("frame: " << frame);
+        REQUIRE(std::ranges::equal(s.value(), make_state(frame)));
+    }
+}
+
+TEST_CASE("Rewinder keeps the most recent frames", "[rewind]")
+{
+    constexpr std::size_t MAX_FRAMES = 150;
+    Rewinder rw;
+    rw.reset(STATE_SIZE, MAX_FRAMES, 64 * 1024 * 1024);
+    unsigned frames = MAX_FRAMES * 4 + 17;
+    for (unsigned i = 0; i < frames; i++)
+        push(rw, i);
+    // whole keyframe intervals are dropped at a time
+    REQUIRE(rw.size() >= MAX_FRAMES);
+    REQUIRE(rw.size() <= MAX_FRAMES + Rewinder::KEYFRAME_INTERVAL);
+    REQUIRE(!rw.rewind(rw.size()));
+    check_all(rw, frames - 1);
+}
+
+TEST_CASE("Rewinder rewinds across keyframes", "[rewind]")
+{
+    constexpr auto K = Rewinder::KEYFRAME_INTERVAL;
+    Rewinder rw;
+    rw.reset(STATE_SIZE, 1000, 64 * 1024 * 1024);
+    for (unsigned i = 0; i < K * 3 + 10; i++)
+        push(rw, i);
+
+    // from a delta two keyframes later to the delta just before a keyframe
+    auto s = rw.rewind(K * 2 + 10);
+    REQUIRE(s);
+    REQUIRE(std::ranges::equal(s.value(), make_state(K - 1)));
+    REQUIRE(rw.size() == K);
+
+    // then forward again, with new frames, and back onto the keyframe
+    for (unsigned i = K; i < K * 2 + 5; i++)
+        push(rw, i);
+    s = rw.rewind(4);
+    REQUIRE(s);
+    REQUIRE(std::ranges::equal(s.value(), make_state(K * 2)));
+    check_all(rw, K * 2);
+}
+
+TEST_CASE("Rewinder stays within its buffer", "[rewind]")
+{
+    // room for a few keyframes and their deltas only, so the buffer wraps
+    // around many times
+    Rewinder rw;
+    rw.reset(STATE_SIZE, 10000, STATE_SIZE * 8);
+    auto memory = rw.memory_used();
+    unsigned frames = 2000;
+    for (unsigned i = 0; i < frames; i++) {
+        push(rw, i);
+        REQUIRE(rw.size() > 0);
+        REQUIRE(rw.memory_used() == memory);
+    }
+    REQUIRE(rw.size() < frames);
+    check_all(rw, frames - 1);
+}
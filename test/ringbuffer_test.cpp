@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include <emu/util/ringbuffer.hpp>
+#include <catch2/catch.hpp>
+
+using util::RingBuffer;
+
+TEST_CASE("RingBuffer capacity is rounded up to a power of two", "[ringbuffer]")
+{
+    REQUIRE(RingBuffer<int>(1).capacity() == 1);
+    REQUIRE(RingBuffer<int>(5).capacity() == 8);
+    REQUIRE(RingBuffer<int>(64).capacity() == 64);
+    REQUIRE(RingBuffer<int>(65).capacity() == 128);
+}
+
+TEST_CASE("RingBuffer full and empty", "[ringbuffer]")
+{
+    RingBuffer<int> ring{8};
+    std::vector<int> in(10), out(10, -1);
+    std::iota(in.begin(), in.end(), 0);
+
+    // empty
+    REQUIRE(ring.size() == 0);
+    REQUIRE(ring.pop(out) == 0);
+    REQUIRE(out[0] == -1);
+    REQUIRE(ring.push(std::span<const int>{}) == 0);
+
+    // a push past capacity only writes what fits
+    REQUIRE(ring.push(in) == 8);
+    REQUIRE(ring.size() == 8);
+    REQUIRE(ring.push(std::span{in}.subspan(8)) == 0);
+    REQUIRE(ring.size() == 8);
+
+    // one free slot lets exactly one item in
+    REQUIRE(ring.pop(std::span{out}.first(1)) == 1);
+    REQUIRE(out[0] == 0);
+    REQUIRE(ring.push(std::span{in}.subspan(8)) == 1);
+    REQUIRE(ring.size() == 8);
+
+    // a pop bigger than the contents only reads what's there
+    REQUIRE(ring.pop(out) == 8);
+    REQUIRE(std::vector(out.begin(), out.begin() + 8) == std::vector{1, 2, 3, 4, 5, 6, 7, 8});
+    REQUIRE(ring.size() == 0);
+    REQUIRE(ring.pop(out) == 0);
+}
+
+TEST_CASE("RingBuffer push and pop across the end of the buffer", "[ringbuffer]")
+{
+    RingBuffer<int> ring{16};
+    int next_in = 0, next_out = 0;
+    // sizes that aren't factors of the capacity, so every offset gets to
+    // be the one where a push or pop wraps
+    for (int round = 0; round < 200; round++) {
+        std::vector<int> in(round % 7 + 1);
+        std::iota(in.begin(), in.end(), next_in);
+        auto pushed = ring.push(in);
+        next_in += pushed;
+
+        std::vector<int> out(round % 5 + 1);
+        auto popped = ring.pop(out);
+        for (std::size_t i = 0; i < popped; i++)
+            REQUIRE(out[i] == next_out++);
+        REQUIRE(ring.size() == std::size_t(next_in - next_out));
+    }
+    REQUIRE(next_in > 16 * 10);
+
+    std::vector<int> out(16);
+    auto popped = ring.pop(out);
+    for (std::size_t i = 0; i < popped; i++)
+        REQUIRE(out[i] == next_out++);
+    REQUIRE(next_out == next_in);
+}
+
+TEST_CASE("RingBuffer with a producer and a consumer thread", "[ringbuffer]")
+{
+    constexpr unsigned COUNT = 1'000'000;
+    RingBuffer<unsigned> ring{64};
+
+    std::thread producer([&] {
+        std::vector<unsigned> chunk;
+        for (unsigned next = 0, size = 1; next < COUNT; size = size % 37 + 1) {
+            chunk.resize(std::min(size, COUNT - next));
+            std::iota(chunk.begin(), chunk.end(), next);
+            std::span<const unsigned> rest = chunk;
+            while (!rest.empty()) {
+                rest = rest.subspan(ring.push(rest));
+                std::this_thread::yield();
+            }
+            next += chunk.size();
+        }
+    });
+
+    // any item out of sequence (lost, repeated or torn) fails the test
+    unsigned expected = 0, errors = 0;
+    std::vector<unsigned> out(29);
+    while (expected < COUNT) {
+        auto n = ring.pop(out);
+        for (std::size_t i = 0; i < n; i++)
+            errors += out[i] != expected++;
+        if (n == 0)
+            std::this_thread::yield();
+    }
+    producer.join();
+    REQUIRE(errors == 0);
+    REQUIRE(ring.size() == 0);
+}